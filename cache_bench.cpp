@@ -18,6 +18,20 @@
 #include "affinity.h"
 #include "papi_wrap.h"
 #include "hwloc_wrap.h"
+#include "options.h"
+#include "protocol.h"
+#include "interference.h"
+#include "verify.h"
+#include "noise.h"
+#include "energy.h"
+#include "clock.h"
+#include "trace.h"
+#include "handoff.h"
+#include "hints.h"
+#include "scenario.h"
+#include "results.h"
+#include "symbols.h"
+#include "campaign.h"
 
 #include <mpi.h>
 
@@ -33,6 +47,8 @@
 #include <cmath>
 #include <cstdlib>
 #include <algorithm>
+#include <limits>
+#include <deque>
 
 #include <iomanip>
 #include <locale>
@@ -40,54 +56,98 @@
 volatile size_t g_val = 5;
 int rank;
 
+// Communicator of the 2 benchmark processes, the world unless running a campaign
+MPI_Comm pair_comm = MPI_COMM_WORLD;
+
 unsigned offset = 0;
 
+// Round trips per sample of the ping-pong tests and outstanding messages of the 
+// streaming tests
+unsigned pingpong_iters = 10;
+unsigned stream_window = 64;
+std::vector<MPI_Request> requests;
+
+// Verification of the cache state before the measured regions
+CacheProbe verifier;
+
+// RAPL energy of the measured regions, with both processes on the same node only the 
+// energy measured by rank 0 is reported
+EnergyMeter energy_meter;
+int energy_shared = 1;
+
+// Timeline of the phases of the tests (NULL if disabled)
+Tracer* tracer = NULL;
+
+// Model of the cycle counter of rank 1 against the one of rank 0 (NULL if disabled)
+ClockSync* clock_sync = NULL;
+
+// OS noise around the measured regions, noisy passes are repeated when discard is set
+NoiseMonitor noise;
+bool noise_discard = false;
+unsigned noise_retries = 3;
+
+// Distance (in lines) of the software prefetch ahead of the access after the receive
+unsigned prefetch_distance = 8;
+
+// Consumer of the shared memory handoff baseline
+HandoffThread* handoff = NULL;
+
 #define ENABLE_SYNCH
 
+// Phases of the tests are recorded into the timeline when tracing is enabled
+#define TRACED(kind, code) \
+	{ \
+	CounterValue _trace_start = tracer ? PAPI_get_real_cyc() : 0; \
+	code \
+	if (tracer) { tracer->record(kind, 0, _trace_start, PAPI_get_real_cyc()); } \
+	}
+
+#define BARRIER TRACED(TRACE_BARRIER, MPI_Barrier(pair_comm);)
+
 #define CLEAN \
 	{ \
-	MPI_Barrier(MPI_COMM_WORLD); \
-	for(register size_t idx=0, end=std::max(cache_size,size); idx<end; idx+=cache_line) { \
-		buff[idx+(idx%(cache_line-1))] += g_val; \
-	} \
+	BARRIER; \
+	TRACED(TRACE_CLEAN, write_lines(buff, std::max(cache_size,size), cache_line, g_val);) \
 	}
 
 //Defines the loop utilized to bring the data into the cache. We do this backwards so that 
 //we are sure L1 and L2 cache are also filled with the values we are going to access in the
 //benchmark
-#define _RCOMP \
-	{\
+#define _RLOAD(b) \
+	TRACED(TRACE_RLOAD, \
 	for(register long idx=size-cache_line; idx>=0; idx-=cache_line) { \
-		g_val+=msg[idx+(idx%(cache_line-1))]; \
+		g_val+=b[idx+(idx%(cache_line-1))]; \
 	} \
-	}
+	)
+
+#define _RCOMP _RLOAD(msg)
 
 // This is the computational loop utilized to load the value of the message buffer
 // into the cache 
 #define RCOMP(x) \
 	{\
 	reg.start(x);\
-	for (register size_t i=0; i<size; i+=cache_line) \
-		g_val += msg[i]; \
+	g_val += read_lines(msg, size, cache_line); \
 	reg.end(x);\
 	}
 
 // This is the computational loop utilized to load the value of the message buffer
 // into the cache 
-#define _WCOMP \
-	{\
+#define _WLOAD(b) \
+	TRACED(TRACE_WLOAD, \
 	for(register long idx=size-cache_line; idx>=0; idx-=cache_line) { \
-		msg[idx+(idx%(cache_line-1))] += g_val; \
+		b[idx+(idx%(cache_line-1))] += g_val; \
 	} \
-	} 
+	)
+
+#define _WCOMP _WLOAD(msg)
 
 // This is the computational loop utilized to load the value of the message buffer
 // into the cache 
 #define WCOMP(x) \
 	{\
 	reg.start(x);\
-	for (register size_t i=0; i<size; i+=cache_line) \
-		msg[i] += g_val; \
+	write_lines(msg, size, cache_line, g_val); \
 	reg.end(x);\
 	}
 
@@ -97,24 +157,113 @@ unsigned offset = 0;
 	{\
 	if (rank == 0) {\
 		reg.start(x); \
-		PMPI_Send((char*)msg, size, MPI_BYTE, 1, 0, MPI_COMM_WORLD);\
+		PMPI_Send((char*)msg, size, MPI_BYTE, 1, 0, pair_comm);\
 		reg.end(x); \
 	} else {\
 		reg.start(x); \
-		PMPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);\
+		PMPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, pair_comm, MPI_STATUS_IGNORE);\
 		reg.end(x); \
 	}\
 	}
 
 // Warm up the instruction cache 
 #define _COMM \
+	TRACED(TRACE_SYNC, \
 	if (rank == 0) { \
-		PMPI_Recv(NULL, 0, MPI_BYTE, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE); \
-		PMPI_Send(NULL, 0, MPI_BYTE, 1, 1, MPI_COMM_WORLD); \
+		PMPI_Recv(NULL, 0, MPI_BYTE, 1, 0, pair_comm, MPI_STATUS_IGNORE); \
+		PMPI_Send(NULL, 0, MPI_BYTE, 1, 1, pair_comm); \
 	} else { \
-		PMPI_Send(NULL, 0, MPI_BYTE, 0, 0, MPI_COMM_WORLD); \
-		PMPI_Recv(NULL, 0, MPI_BYTE, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE); \
+		PMPI_Send(NULL, 0, MPI_BYTE, 0, 0, pair_comm); \
+		PMPI_Recv(NULL, 0, MPI_BYTE, 0, 1, pair_comm, MPI_STATUS_IGNORE); \
+	} \
+	)
+
+// Round-trip ping-pong between the 2 processes, the message goes back and forth
+// pingpong_iters times within the region
+#define PINGPONG(x) \
+	{\
+	reg.start(x); \
+	for (unsigned it=0; it<pingpong_iters; ++it) { \
+		if (rank == 0) {\
+			PMPI_Send((char*)msg, size, MPI_BYTE, 1, 0, pair_comm);\
+			PMPI_Recv((char*)msg, size, MPI_BYTE, 1, 0, pair_comm, MPI_STATUS_IGNORE);\
+		} else {\
+			PMPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, pair_comm, MPI_STATUS_IGNORE);\
+			PMPI_Send((char*)msg, size, MPI_BYTE, 0, 0, pair_comm);\
+		}\
 	} \
+	reg.end(x); \
+	}
+
+// Windowed streaming: the sender keeps stream_window messages in flight and the
+// receiver acknowledges the whole window with a zero-size message. As in the 
+// standard MPI bandwidth benchmarks all the messages of the window use the same buffer
+#define STREAM(x) \
+	{\
+	reg.start(x); \
+	if (rank == 0) {\
+		for (unsigned w=0; w<stream_window; ++w) \
+			PMPI_Isend((char*)msg, size, MPI_BYTE, 1, 0, pair_comm, &requests[w]);\
+		PMPI_Waitall(stream_window, &requests.front(), MPI_STATUSES_IGNORE);\
+		PMPI_Recv(NULL, 0, MPI_BYTE, 1, 1, pair_comm, MPI_STATUS_IGNORE);\
+	} else {\
+		for (unsigned w=0; w<stream_window; ++w) \
+			PMPI_Irecv((char*)msg, size, MPI_BYTE, 0, 0, pair_comm, &requests[w]);\
+		PMPI_Waitall(stream_window, &requests.front(), MPI_STATUSES_IGNORE);\
+		PMPI_Send(NULL, 0, MPI_BYTE, 0, 1, pair_comm);\
+	}\
+	reg.end(x); \
+	}
+
+// The receive buffer of the bidirectional tests lives after the buff array utilized
+// by CLEAN, this way cleaning the cache does not load the receive buffer
+#define RBUFF (buff + std::max(cache_size,size))
+
+// Cache state of a buffer before the measured region
+enum CacheState { STATE_COLD=0, STATE_READ=1, STATE_WRITE=2 };
+const char* state_names[] = { "cold", "read", "write" };
+
+#define SETUP(state, b) \
+	{\
+	if (state == STATE_READ)  _RLOAD(b) \
+	if (state == STATE_WRITE) _WLOAD(b) \
+	}
+
+// Checks that the buffer is really in the intended state right before the measured 
+// region (only when the verification is enabled). A buffer larger than the last level
+// cache cannot be hot, the hot states are only verified when the buffer fits
+#define VERIFY(state, b) \
+	{\
+	if (verifier.is_enabled() && (state) != STATE_COLD && size > cache_size) \
+		verifier.skip(); \
+	else if (verifier.is_enabled()) \
+		verifier.check((state) == STATE_COLD ? PROBE_COLD : PROBE_HOT, b, size, cache_line); \
+	}
+
+// Bidirectional exchange, both processes send msg to and receive RBUFF from 
+// the other one at the same time 
+#define SENDRECV(x) \
+	{\
+	reg.start(x); \
+	PMPI_Sendrecv((char*)msg, size, MPI_BYTE, 1-rank, 0, \
+				  (char*)RBUFF, size, MPI_BYTE, 1-rank, 0, pair_comm, MPI_STATUS_IGNORE); \
+	reg.end(x); \
+	}
+
+// Bidirectional exchange with non-blocking operations. The exchange is split into
+// 2 regions so that counters are available per direction: x covers the posting of 
+// both operations and the completion of the send, x+100 the completion of the receive
+#define ISENDRECV(x) \
+	{\
+	reg.start(x); \
+	PMPI_Irecv((char*)RBUFF, size, MPI_BYTE, 1-rank, 0, pair_comm, &requests[1]); \
+	PMPI_Isend((char*)msg, size, MPI_BYTE, 1-rank, 0, pair_comm, &requests[0]); \
+	PMPI_Wait(&requests[0], MPI_STATUS_IGNORE); \
+	reg.end(x); \
+	reg.start(x+100); \
+	PMPI_Wait(&requests[1], MPI_STATUS_IGNORE); \
+	reg.end(x+100); \
+	}
 
 #define MEMCPY(x) \
 	{ \
@@ -123,6 +272,79 @@ unsigned offset = 0;
 	reg.end(x); \
 	} 
 
+// Warm up the instruction cache 
+#define _MEMCPY memcpy((char*)buff, (char*)msg, 0)
+
+#define NTCOPY(x) \
+	{ \
+	reg.start(x); \
+	nt_copy((char*)buff, (char*)msg, size); \
+	reg.end(x); \
+	} 
+
+#define _NTCOPY nt_copy((char*)buff, (char*)msg, 0)
+
+// The helper thread (already spinning) copies msg into buff 
+#define HANDOFF(x) \
+	{ \
+	reg.start(x); \
+	handoff->handoff(buff, msg, size); \
+	reg.end(x); \
+	} 
+
+// The payload msg[0,size) is made of K messages of size/K bytes: either they are sent 
+// one by one, or they are packed into RBUFF, sent at once and unpacked by the receiver 
+#define MANY(x, K) \
+	{\
+	size_t chunk = size/(K); \
+	reg.start(x); \
+	for (unsigned k=0; k<(K); ++k) { \
+		if (rank == 0) {\
+			PMPI_Send((char*)msg + k*chunk, chunk, MPI_BYTE, 1, 0, pair_comm);\
+		} else {\
+			PMPI_Recv((char*)msg + k*chunk, chunk, MPI_BYTE, 0, 0, pair_comm, MPI_STATUS_IGNORE);\
+		}\
+	} \
+	reg.end(x); \
+	}
+
+#define PACK(x, K) \
+	{\
+	size_t chunk = size/(K); \
+	reg.start(x); \
+	for (unsigned k=0; k<(K); ++k) \
+		memcpy((char*)RBUFF + k*chunk, (char*)msg + k*chunk, chunk); \
+	reg.end(x); \
+	}
+
+#define UNPACK(x, K) \
+	{\
+	size_t chunk = size/(K); \
+	reg.start(x); \
+	for (unsigned k=0; k<(K); ++k) \
+		memcpy((char*)msg + k*chunk, (char*)RBUFF + k*chunk, chunk); \
+	reg.end(x); \
+	}
+
+// Packed variant: the sender packs and sends, the receiver receives and unpacks. Only the
+// K chunks are transferred, as by the K sends (the tail of a size which is not a multiple 
+// of K is not packed)
+#define PACKED(x, K) \
+	{\
+	const size_t packed = (K)*(size/(K)); \
+	if (rank == 0) {\
+		PACK(x, K); \
+		reg.start(x+100); \
+		PMPI_Send((char*)RBUFF, packed, MPI_BYTE, 1, 0, pair_comm);\
+		reg.end(x+100); \
+	} else {\
+		reg.start(x+100); \
+		PMPI_Recv((char*)RBUFF, packed, MPI_BYTE, 0, 0, pair_comm, MPI_STATUS_IGNORE);\
+		reg.end(x+100); \
+		UNPACK(x+200, K); \
+	}\
+	}
+
 typedef void (*TestFunc)(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size);
 
 //=============================================================================
@@ -135,7 +357,7 @@ void test_1(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 	RCOMP(101100+offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
@@ -149,7 +371,7 @@ void test_2(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 	RCOMP(102100+offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
@@ -164,7 +386,7 @@ void test_3(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 	WCOMP(203100+offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
@@ -179,7 +401,7 @@ void test_4(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 	WCOMP(204100+offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
@@ -192,6 +414,8 @@ void test_5(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 	
 	_COMM;
 
+	VERIFY(STATE_COLD, msg);
+
 	COMM(305200+offset);
 
 #ifdef ENABLE_SYNCH
@@ -211,6 +435,8 @@ void test_6(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 
 	_COMM;
 
+	VERIFY(STATE_READ, msg);
+
 	COMM(306200+offset);
 
 #ifdef ENABLE_SYNCH
@@ -229,6 +455,8 @@ void test_7(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 
 	_COMM;
 
+	VERIFY(STATE_WRITE, msg);
+
 	COMM(307200+offset);
 
 #ifdef ENABLE_SYNCH
@@ -237,286 +465,1681 @@ void test_7(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t
 }
 
 //=============================================================================
-// TEST 8: Send/recv array from memory when cache is hot (write)
+// TEST 8: Local copy baseline, memcpy of the array when cache is cold
 //=============================================================================
 void test_8(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	// Load array into cache
 	CLEAN;
 
-	memcpy(NULL, NULL, 0);
+	_MEMCPY;
+
+	VERIFY(STATE_COLD, msg);
 
 	MEMCPY(408100 + offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
 //=============================================================================
-// TEST 8: Send/recv array from memory when cache is hot (write)
+// TEST 9: Local copy baseline, memcpy of the array when cache is hot (read)
 //=============================================================================
 void test_9(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
 	CLEAN;
-	// Load array into cache
-	memcpy(NULL, NULL, 0);
 
+	_MEMCPY;
+
+	// Load array into cache
 	_RCOMP;
 
+	VERIFY(STATE_READ, msg);
+
 	MEMCPY(409100 + offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
 //=============================================================================
-// TEST 11: Send/recv array from memory when cache is hot (write)
+// TEST 10: Local copy baseline, memcpy of the array when cache is hot (write)
 //=============================================================================
 void test_10(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
 	CLEAN;
-	// Load array into cache
-	
-	memcpy(NULL, NULL, 0);
 
+	_MEMCPY;
+
+	// Load array into cache
 	_WCOMP;
 
+	VERIFY(STATE_WRITE, msg);
+
 	MEMCPY(410100 + offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
 //=============================================================================
-// TEST 1: Load array (read mode) from memory when cache is cold
-//         [ cached is cleaned up and then msg array is accessed]
+// TEST 11: Local copy baseline, non-temporal copy of the array when cache is cold
 //=============================================================================
-void test_20(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+void test_11(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
 	CLEAN;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	_NTCOPY;
+
+	VERIFY(STATE_COLD, msg);
 
-	RCOMP(720100+offset);
+	NTCOPY(411100 + offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_21(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+//=============================================================================
+// TEST 12: Local copy baseline, non-temporal copy of the array when cache is hot (read)
+//=============================================================================
+void test_12(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
 	CLEAN;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	_NTCOPY;
 
+	// Load array into cache
 	_RCOMP;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	VERIFY(STATE_READ, msg);
 
-	RCOMP(721100+offset);
+	NTCOPY(412100 + offset);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_22(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	// Load array into cache
+//=============================================================================
+// TEST 13: Local copy baseline, non-temporal copy of the array when cache is hot (write)
+//=============================================================================
+void test_13(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
 	CLEAN;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	_NTCOPY;
 
-	if (rank == 0) {
-		MPI_Send((char*)msg, size, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-	} else {
-		MPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	}
+	// Load array into cache
+	_WCOMP;
+
+	VERIFY(STATE_WRITE, msg);
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	NTCOPY(413100 + offset);
 
-	RCOMP(722100+offset);
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_23(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	// Load array into cache
-	CLEAN;
-
-	MPI_Barrier(MPI_COMM_WORLD);
+//=============================================================================
+// TEST 14: Local copy baseline, handoff to the helper thread of the array when cache is cold
+//=============================================================================
+void test_14(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	if (!handoff) { return; }
 
-	_RCOMP
+	handoff->arm();
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	CLEAN;
 
+	VERIFY(STATE_COLD, msg);
 
-	if (rank == 0) {
-		MPI_Send((char*)msg, size, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-	} else {
-		MPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	}
+	HANDOFF(414100 + offset);
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	handoff->disarm();
 
-	RCOMP(723100+offset);
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_30(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+//=============================================================================
+// TEST 15: Local copy baseline, handoff to the helper thread of the array when cache is hot (read)
+//=============================================================================
+void test_15(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	if (!handoff) { return; }
+
+	handoff->arm();
+
 	CLEAN;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	// Load array into cache
+	_RCOMP;
+
+	VERIFY(STATE_READ, msg);
 
-	WCOMP(830100+offset);
+	HANDOFF(415100 + offset);
+
+	handoff->disarm();
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_31(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	CLEAN;
+//=============================================================================
+// TEST 16: Local copy baseline, handoff to the helper thread of the array when cache is hot (write)
+//=============================================================================
+void test_16(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	if (!handoff) { return; }
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	handoff->arm();
 
+	CLEAN;
+
+	// Load array into cache
 	_WCOMP;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	VERIFY(STATE_WRITE, msg);
+
+	HANDOFF(416100 + offset);
 
-	WCOMP(831100+offset);
+	handoff->disarm();
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	BARRIER;
 #endif
 }
 
-void test_32(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	// Load array into cache
-	CLEAN;
+//=============================================================================
+// TEST 700-775: Composed scenarios, a buffer state is set up (cold, read, write),
+//               an operation is executed (none or send/recv of the buffer) and the
+//               buffer is accessed by the observer (read or write of Width bytes of
+//               every line). The test ID is 7OX with O = 5*observer + width index
+//               (1, 8 bytes or the whole line) and X = 3*operation + setup state,
+//               region 1 is the operation and region 2 the observer
+//=============================================================================
+enum ScenarioOp { OP_NONE=0, OP_COMM=1 };
+enum ScenarioObserver { OBSERVE_READ=0, OBSERVE_WRITE=1 };
 
-	MPI_Barrier(MPI_COMM_WORLD);
+template <int Setup, int Op, int Observer, size_t Line, size_t Width>
+struct Scenario {
 
-	if (rank == 0) {
-		MPI_Send((char*)msg, size, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-	} else {
-		MPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	}
+	enum { TEST = 700 + 10*(5*Observer + (Width == 1 ? 0 : Width == 8 ? 1 : 2)) + 3*Op + Setup };
+
+	static void run(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+		const RegionCounter::RegionID id = TEST*1000 + offset;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+		CLEAN;
 
-	WCOMP(832100+offset);
+		SETUP(Setup, msg);
+
+		// the state entering the operation (or the observer when there is none)
+		VERIFY(Setup, msg);
+
+		BARRIER;
+
+		if (Op == OP_COMM) {
+			COMM(id+100);
+
+			BARRIER;
+		}
+
+		reg.start(id+200);
+		if (Observer == OBSERVE_READ) {
+			g_val += LineAccess<Line,Width>::read(msg, size);
+		} else {
+			LineAccess<Line,Width>::write(msg, size, g_val);
+		}
+		reg.end(id+200);
 
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+		BARRIER;
 #endif
-}
+	}
+};
 
-void test_33(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
-	// Load array into cache
-	CLEAN;
+/**
+ * Appends the whole matrix of scenarios specialized for the given cache line
+ */
+template <size_t Line>
+void add_scenarios(std::vector<TestFunc>& tests) {
+#define SCENARIOS(obs, width) \
+	tests.push_back(&Scenario<STATE_COLD,  OP_NONE, obs, Line, width>::run); \
+	tests.push_back(&Scenario<STATE_READ,  OP_NONE, obs, Line, width>::run); \
+	tests.push_back(&Scenario<STATE_WRITE, OP_NONE, obs, Line, width>::run); \
+	tests.push_back(&Scenario<STATE_COLD,  OP_COMM, obs, Line, width>::run); \
+	tests.push_back(&Scenario<STATE_READ,  OP_COMM, obs, Line, width>::run); \
+	tests.push_back(&Scenario<STATE_WRITE, OP_COMM, obs, Line, width>::run);
+	SCENARIOS(OBSERVE_READ, 1) SCENARIOS(OBSERVE_READ, 8) SCENARIOS(OBSERVE_READ, Line)
+	SCENARIOS(OBSERVE_WRITE, 1) SCENARIOS(OBSERVE_WRITE, 8) SCENARIOS(OBSERVE_WRITE, Line)
+#undef SCENARIOS
+}
 
-	MPI_Barrier(MPI_COMM_WORLD);
+/**
+ * Scenarios for the cache line of the machine, only 64 and 128 bytes lines are compiled
+ */
+void add_scenarios(std::vector<TestFunc>& tests, size_t cache_line) {
+	if (cache_line == 128) { 
+		add_scenarios<128>(tests);
+		return;
+	}
+	if (cache_line != 64) {
+		std::cerr << "[R" << rank << "] WARNING: no scenarios for cache line " << cache_line 
+				  << ", using 64 bytes" << std::endl;
+	}
+	add_scenarios<64>(tests);
+}
 
-	_WCOMP
+//=============================================================================
+// TEST 40: Ping-pong latency when cache is cold
+//=============================================================================
+void test_40(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	_COMM;
 
-	if (rank == 0) {
-		MPI_Send((char*)msg, size, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-	} else {
-		MPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-	}
+	VERIFY(STATE_COLD, msg);
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	PINGPONG(540200+offset);
 
-	WCOMP(833100+offset);
 #ifdef ENABLE_SYNCH
-	MPI_Barrier(MPI_COMM_WORLD);
+	_COMM;
 #endif
 }
 
-class BenchBinder {
-
-	TestFunc	func_ptr;
-	volatile char*	msg_ptr;
-	volatile char*  buff_ptr;
-	size_t 		cache_size;
-	size_t 		curr_size;
-	unsigned 	cache_line;
+//=============================================================================
+// TEST 41: Ping-pong latency when cache is hot (read)
+//=============================================================================
+void test_41(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
 
-public:
-	BenchBinder(const TestFunc& func_ptr, 
-				volatile char* msg_ptr, 
-				volatile char* buff_ptr, 
-				size_t cache_size, 
-				size_t curr_size, 
-				unsigned cache_line) 
-		: func_ptr(func_ptr),
-		  msg_ptr(msg_ptr), 
-		  buff_ptr(buff_ptr), 
-		  cache_size(cache_size), 
-		  curr_size(curr_size), 
-		  cache_line(cache_line) { } 
+	// Load array into cache
+	_RCOMP;
 
-	inline void operator()(RegionCounter& reg) const {
-		return func_ptr(reg, msg_ptr, buff_ptr, cache_size, cache_line, curr_size);
-	}
-};
+	_COMM;
 
+	VERIFY(STATE_READ, msg);
 
-void measure(unsigned rep, std::ostream& logFile, const EventNames& evts, size_t cache_size, size_t cache_line_size) 
-{
-	
-	TestFunc benchs[] = {
-			//  &test_1,  &test_2,
-			&test_5,  &test_6, &test_7,
-			//&test_8,  &test_9 , &test_10,
-			test_20, test_21, test_22, test_23,
-			test_30, test_31, test_32, test_33,
-		};
+	PINGPONG(541200+offset);
 
-	offset = 0; 
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
 
-	MPI_Barrier(MPI_COMM_WORLD);
-	!rank && std::cout << "~~~> Benchmark STARTS <~~~" << std::endl;
-	!rank && std::cout << "     + Don't move and hold your breath" << std::endl;
+//=============================================================================
+// TEST 42: Ping-pong latency when cache is hot (write)
+//=============================================================================
+void test_42(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
 
-	for (register size_t size = 64; size <= cache_size*4; size*=2) {
-		
-		MPI_Barrier(MPI_COMM_WORLD);
-		!rank && std::cout << "Measuring for size: " << size << std::endl;
-		
-		++offset;
+	// Load array into cache
+	_WCOMP;
 
-		size_t buff_size = std::max(cache_size, size);
-		volatile char* msg = new char[ 2 * buff_size ];
-		// printf("BUFF: %x - %x\n", buff, (buff + buff_size));
+	_COMM;
 
-		volatile char* buff  = &msg[ buff_size ];
-		// printf("MSG: %x - %x\n", msg, (msg + buff_size));
-		memset((char*)msg, sizeof(char) * 2 * buff_size, 2);
+	VERIFY(STATE_WRITE, msg);
 
-		for(size_t idx=0; idx<11; ++idx) {
-			measure(logFile, evts, BenchBinder(benchs[idx], msg, buff, cache_size, size, cache_line_size), rep);
-			!rank && std::cout << "%" << std::flush;
-		}
-		!rank && std::cout << std::endl;
+	PINGPONG(542200+offset);
 
-		delete[] msg;
-	}
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
 }
 
-size_t read_counter_names(const std::string& file_name, std::vector<std::string>& counter_names) {
-	size_t max_lenght=0;
-	try {
-		std::ifstream file(file_name.c_str(), std::ifstream::in);
+//=============================================================================
+// TEST 50: Streaming bandwidth when cache is cold
+//=============================================================================
+void test_50(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
 
-		std::string line;
-		while(std::getline(file, line)) { 
-			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
-			counter_names.push_back(line); 
+	_COMM;
+
+	VERIFY(STATE_COLD, msg);
+
+	STREAM(550200+offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+//=============================================================================
+// TEST 51: Streaming bandwidth when cache is hot (read)
+//=============================================================================
+void test_51(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
+
+	// Load array into cache
+	_RCOMP;
+
+	_COMM;
+
+	VERIFY(STATE_READ, msg);
+
+	STREAM(551200+offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+//=============================================================================
+// TEST 52: Streaming bandwidth when cache is hot (write)
+//=============================================================================
+void test_52(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
+
+	// Load array into cache
+	_WCOMP;
+
+	_COMM;
+
+	VERIFY(STATE_WRITE, msg);
+
+	STREAM(552200+offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+//=============================================================================
+// TEST 60-68: Bidirectional exchange (MPI_Sendrecv), the state of the send and of
+//             the receive buffer is set independently
+//=============================================================================
+template <int SendState, int RecvState>
+void test_sendrecv(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
+
+	SETUP(SendState, msg);
+	SETUP(RecvState, RBUFF);
+
+	_COMM;
+
+	VERIFY(SendState, msg);
+	VERIFY(RecvState, RBUFF);
+
+	SENDRECV(560200 + (3*SendState+RecvState)*1000 + offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+//=============================================================================
+// TEST 70-78: Bidirectional exchange (MPI_Isend + MPI_Irecv), the state of the 
+//             send and of the receive buffer is set independently
+//=============================================================================
+template <int SendState, int RecvState>
+void test_isendrecv(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
+
+	SETUP(SendState, msg);
+	SETUP(RecvState, RBUFF);
+
+	_COMM;
+
+	VERIFY(SendState, msg);
+	VERIFY(RecvState, RBUFF);
+
+	ISENDRECV(570200 + (3*SendState+RecvState)*1000 + offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+//=============================================================================
+// TEST 600-622: Send/recv array when the state of the sender buffer and the state
+//               of the receiver buffer differ. The test ID is 6SR, with S and R
+//               the cache state (cold, read, write) of the sender and receiver
+//=============================================================================
+template <int SendState, int RecvState>
+void test_asym(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	CLEAN;
+
+	if (rank == 0) {
+		SETUP(SendState, msg);
+	} else {
+		SETUP(RecvState, msg);
+	}
+
+	_COMM;
+
+	VERIFY(rank == 0 ? SendState : RecvState, msg);
+
+	COMM(600200 + (10*SendState+RecvState)*1000 + offset);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+// Largest number of messages aggregated by the tests 9KS
+unsigned agg_max_k = 64;
+
+// Messages smaller than this are not aggregated
+#define AGG_MIN_CHUNK 8
+
+//=============================================================================
+// TEST 900-962: Aggregation of small messages. The payload is transferred as 
+//               K = 2^KLog messages of size/K bytes (region 1) or packed into
+//               one message (regions 2: pack, 3: send/recv, 4: unpack). The 
+//               test ID is 9KS, with S the cache state of the payload
+//=============================================================================
+template <int KLog, int State>
+void test_aggregate(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	const unsigned K = 1u << KLog;
+	if (K > agg_max_k || size/K < AGG_MIN_CHUNK) { return; }
+
+	const RegionCounter::RegionID id = 900000 + (10*KLog+State)*1000 + offset;
+
+	CLEAN;
+	SETUP(State, msg);
+	_COMM;
+	VERIFY(State, msg);
+
+	MANY(id+100, K);
+
+	CLEAN;
+	SETUP(State, msg);
+	_COMM;
+	VERIFY(State, msg);
+
+	PACKED(id+200, K);
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+// Access of the receive buffer with a software prefetch prefetch_distance lines ahead 
+// (a prefetch past the end of the buffer does not fault)
+#define RCOMP_PF(x) \
+	{\
+	const size_t ahead = prefetch_distance*cache_line; \
+	reg.start(x);\
+	for (register size_t i=0; i<size; i+=cache_line) { \
+		__builtin_prefetch((const char*)msg + i + ahead, 0, 3); \
+		g_val += msg[i]; \
+	} \
+	reg.end(x);\
+	}
+
+#define WCOMP_PF(x) \
+	{\
+	const size_t ahead = prefetch_distance*cache_line; \
+	reg.start(x);\
+	for (register size_t i=0; i<size; i+=cache_line) { \
+		__builtin_prefetch((const char*)msg + i + ahead, 1, 3); \
+		msg[i] += g_val; \
+	} \
+	reg.end(x);\
+	}
+
+//=============================================================================
+// TEST 200-241: Cache hints around the transfer of a message which is accessed 
+//               right after the receive (as tests 22 and 32). The sender produces 
+//               the message (write) and the receive buffer is cold, the hint is:
+//               none, prefetch of the receive buffer before posting the receive, 
+//               prefetch ahead of the access after the receive, cldemote of the 
+//               message before the send, message produced with non-temporal stores.
+//               The test ID is 2HA with H the hint and A the access (0 read, 1 write),
+//               region 1 is the send/recv (hint included) and region 2 the access
+//=============================================================================
+template <int Hint, int Write>
+void test_hint(RegionCounter& reg, volatile char* msg, volatile char* buff, size_t cache_size, size_t cache_line, size_t size) {
+	const RegionCounter::RegionID id = 200000 + (10*Hint+Write)*1000 + offset;
+
+	CLEAN;
+
+	if (rank == 0) {
+		if (Hint == HINT_NT_SEND) {
+			nt_fill(msg, g_val, size);
+		} else {
+			_WCOMP;
+		}
+	}
+
+	_COMM;
+
+	VERIFY(rank == 0 && Hint != HINT_NT_SEND ? STATE_WRITE : STATE_COLD, msg);
+
+	if (rank == 0) {
+		reg.start(id+100);
+		if (Hint == HINT_CLDEMOTE) { cldemote_lines(msg, size, cache_line); }
+		PMPI_Send((char*)msg, size, MPI_BYTE, 1, 0, pair_comm);
+		reg.end(id+100);
+	} else {
+		reg.start(id+100);
+		if (Hint == HINT_PREFETCH_POST) { prefetch_lines<1>(msg, size, cache_line); }
+		PMPI_Recv((char*)msg, size, MPI_BYTE, 0, 0, pair_comm, MPI_STATUS_IGNORE);
+		reg.end(id+100);
+
+		if (Hint == HINT_PREFETCH_DONE) {
+			if (Write) { WCOMP_PF(id+200) } else { RCOMP_PF(id+200) }
+		} else {
+			if (Write) { WCOMP(id+200) } else { RCOMP(id+200) }
+		}
+	}
+
+#ifdef ENABLE_SYNCH
+	_COMM;
+#endif
+}
+
+class BenchBinder {
+
+	TestFunc	func_ptr;
+	volatile char*	msg_ptr;
+	volatile char*  buff_ptr;
+	size_t 		cache_size;
+	size_t 		curr_size;
+	unsigned 	cache_line;
+
+public:
+	BenchBinder(const TestFunc& func_ptr, 
+				volatile char* msg_ptr, 
+				volatile char* buff_ptr, 
+				size_t cache_size, 
+				size_t curr_size, 
+				unsigned cache_line) 
+		: func_ptr(func_ptr),
+		  msg_ptr(msg_ptr), 
+		  buff_ptr(buff_ptr), 
+		  cache_size(cache_size), 
+		  curr_size(curr_size), 
+		  cache_line(cache_line) { } 
+
+	inline void operator()(RegionCounter& reg) const {
+		if (!verifier.is_enabled() && !noise_discard) {
+			return func_ptr(reg, msg_ptr, buff_ptr, cache_size, cache_line, curr_size);
+		}
+
+		// The pass is repeated (overwriting the values of the regions) until both processes
+		// started from the intended cache state and were not disturbed by the OS
+		unsigned max_retries = std::max(verifier.is_enabled() ? verifier.max_retries() : 0, 
+										noise_discard ? noise_retries : 0);
+		for (unsigned attempt=0; ; ++attempt) {
+			verifier.reset();
+			reg.take_noisy();
+			func_ptr(reg, msg_ptr, buff_ptr, cache_size, cache_line, curr_size);
+
+			int ok[2] = { verifier.is_valid(), !(noise_discard && reg.take_noisy()) }, all_ok[2];
+			MPI_Allreduce(ok, all_ok, 2, MPI_INT, MPI_LAND, pair_comm);
+			if ((all_ok[0] && all_ok[1]) || attempt == max_retries) { 
+				if (verifier.is_enabled()) { reg.tag_state(verifier.get_observed(), all_ok[0]); }
+				break;
+			}
+		}
+	}
+};
+
+
+// Describes the regions of the ping-pong, streaming and bidirectional tests (IDs 
+// without the size offset) used to derive latency and bandwidth
+struct TransferDesc {
+	RegionCounter::RegionID id;
+	// optional second region which completes the transfer (0 if none)
+	RegionCounter::RegionID id2;
+	std::string 			pattern;
+	std::string				state;
+	// sequential transfers within the region and directions of each transfer
+	unsigned 				rounds;
+	unsigned 				directions;
+
+	TransferDesc(RegionCounter::RegionID id, RegionCounter::RegionID id2, const std::string& pattern, 
+				 const std::string& state, unsigned rounds, unsigned directions) 
+		: id(id), id2(id2), pattern(pattern), state(state), rounds(rounds), directions(directions) { }
+};
+
+std::vector<TransferDesc> transfer_tests() {
+	std::vector<TransferDesc> ret;
+	for (unsigned st=0; st<3; ++st) {
+		ret.push_back( TransferDesc(540200+st*1000, 0, "pingpong", state_names[st], 2*pingpong_iters, 1) );
+	}
+	for (unsigned st=0; st<3; ++st) {
+		ret.push_back( TransferDesc(550200+st*1000, 0, "stream", state_names[st], stream_window, 1) );
+	}
+	for (unsigned snd=0; snd<3; ++snd) {
+		for (unsigned rcv=0; rcv<3; ++rcv) {
+			std::string state = std::string(state_names[snd]) + "/" + state_names[rcv];
+			RegionCounter::RegionID id = (3*snd+rcv)*1000;
+			ret.push_back( TransferDesc(560200+id, 0, "sendrecv", state, 1, 2) );
+			ret.push_back( TransferDesc(570200+id, 570300+id, "isendrecv", state, 1, 2) );
+		}
+	}
+	return ret;
+}
+
+void report_transfers(std::ostream& out, const RegionSamples& samples, size_t size, double cpu_mhz) {
+	const std::vector<TransferDesc>& tests = transfer_tests();
+
+	for (std::vector<TransferDesc>::const_iterator it=tests.begin(), end=tests.end(); it!=end; ++it) {
+		RegionSamples::const_iterator fit = samples.find(it->id+offset);
+		if (fit == samples.end()) { continue; }
+
+		// time in usecs
+		double time = median(fit->second.begin(), fit->second.end());
+		if (it->id2 != 0) {
+			RegionSamples::const_iterator fit2 = samples.find(it->id2+offset);
+			if (fit2 == samples.end()) { continue; }
+			time += median(fit2->second.begin(), fit2->second.end());
+		}
+		time /= cpu_mhz;
+
+		out << std::setw(10) << it->pattern
+			<< std::setw(12) << it->state
+			<< std::setw(12) << size
+			<< std::setw(15) << time / it->rounds
+			<< std::setw(15) << (it->rounds * it->directions * size) / time
+			<< std::endl;
+	}
+}
+
+// Writes the median time of each sender/receiver state combination as measured by 
+// both processes (collective operation, the table is written by rank 0)
+void report_asymmetric(std::ostream& out, const RegionSamples& samples, size_t size) {
+	double local[9], times[2][9];
+	for (unsigned snd=0; snd<3; ++snd) {
+		for (unsigned rcv=0; rcv<3; ++rcv) {
+			RegionSamples::const_iterator fit = samples.find(600200 + (10*snd+rcv)*1000 + offset);
+			local[3*snd+rcv] = fit == samples.end() ? 0 : median(fit->second.begin(), fit->second.end());
+		}
+	}
+	MPI_Gather(local, 9, MPI_DOUBLE, times, 9, MPI_DOUBLE, 0, pair_comm);
+
+	if (rank != 0) { return; }
+
+	for (unsigned snd=0; snd<3; ++snd) {
+		for (unsigned rcv=0; rcv<3; ++rcv) {
+			unsigned idx = 3*snd+rcv;
+			out << std::setw(12) << size
+				<< std::setw(10) << state_names[snd]
+				<< std::setw(10) << state_names[rcv]
+				<< std::setw(15) << times[0][idx]
+				<< std::setw(15) << times[1][idx]
+				// speedup with respect to both buffers cold
+				<< std::setw(12) << (times[0][idx] ? times[0][0] / times[0][idx] : 0)
+				<< std::setw(12) << (times[1][idx] ? times[1][0] / times[1][idx] : 0)
+				<< std::endl;
+		}
+	}
+}
+
+// Compares the send/recv test with the local copy baselines under the same cache state,
+// the slowest process gives the MPI time and the fastest one the baseline (collective 
+// operation, the table is written by rank 0)
+void report_baselines(std::ostream& out, const RegionSamples& samples, size_t size) {
+	const RegionCounter::RegionID tests[] = { 305200, 408100, 411100, 414100 };
+	const size_t num_tests = sizeof(tests)/sizeof(tests[0]);
+
+	// a baseline which was not measured (i.e. no free core for the handoff) is left out
+	const double missing = std::numeric_limits<double>::max();
+	double local[3][num_tests], mpi[3], baselines[3][num_tests];
+	for (unsigned st=0; st<3; ++st) {
+		for (size_t idx=0; idx<num_tests; ++idx) {
+			RegionSamples::const_iterator fit = samples.find(tests[idx] + st*1000 + offset);
+			local[st][idx] = fit == samples.end() ? (idx ? missing : 0) : median(fit->second.begin(), fit->second.end());
+		}
+		MPI_Reduce(&local[st][0], &mpi[st], 1, MPI_DOUBLE, MPI_MAX, 0, pair_comm);
+		MPI_Reduce(&local[st][1], &baselines[st][1], num_tests-1, MPI_DOUBLE, MPI_MIN, 0, pair_comm);
+	}
+
+	if (rank != 0) { return; }
+
+	for (unsigned st=0; st<3; ++st) {
+		double best = *std::min_element(&baselines[st][1], &baselines[st][num_tests]);
+		out << std::setw(12) << size
+			<< std::setw(8)  << state_names[st]
+			<< std::setw(15) << mpi[st];
+		for (size_t idx=1; idx<num_tests; ++idx) { 
+			if (baselines[st][idx] == missing) { out << std::setw(15) << "-"; } else { out << std::setw(15) << baselines[st][idx]; }
+		}
+		if (best == missing) { out << std::setw(15) << "-" << std::endl; } else { out << std::setw(15) << mpi[st] - best << std::endl; }
+	}
+}
+
+// Compares K sends with the packed transfer of the same payload: the slowest process 
+// gives the time of each choice, for the packed transfer the time of a process is the sum 
+// of its pack/unpack and send/recv regions (collective operation, the table is written 
+// by rank 0)
+void report_aggregation(std::ostream& out, const RegionSamples& samples, size_t size) {
+	for (unsigned k=0; (1u << k) <= agg_max_k && k <= 6; ++k) {
+		if (size/(1u << k) < AGG_MIN_CHUNK) { break; }
+
+		for (unsigned st=0; st<3; ++st) {
+			RegionCounter::RegionID id = 900000 + (10*k+st)*1000 + offset;
+
+			double local[2] = { 0, 0 }, times[2];
+			for (unsigned r=1; r<=4; ++r) {
+				RegionSamples::const_iterator fit = samples.find(id + r*100);
+				if (fit == samples.end()) { continue; }
+				local[r == 1 ? 0 : 1] += median(fit->second.begin(), fit->second.end());
+			}
+			MPI_Reduce(local, times, 2, MPI_DOUBLE, MPI_MAX, 0, pair_comm);
+
+			if (rank != 0) { continue; }
+			out << std::setw(12) << size
+				<< std::setw(8)  << state_names[st]
+				<< std::setw(6)  << (1u << k)
+				<< std::setw(15) << times[0]
+				<< std::setw(15) << times[1]
+				<< std::setw(12) << (times[1] > 0 ? times[0] / times[1] : 0)
+				<< std::setw(8)  << (times[1] < times[0] ? "pack" : "many") << std::endl;
+		}
+	}
+}
+
+// Time of the sender and of the receiver (receive and access of the message) for every 
+// cache hint, the speedup is the one of the receiver against no hint (collective operation,
+// the table is written by rank 0)
+void report_hints(std::ostream& out, const RegionSamples& samples, size_t size) {
+	double local[2][NUM_HINTS][2], times[2][2][NUM_HINTS][2];
+	for (unsigned w=0; w<2; ++w) {
+		for (unsigned h=0; h<NUM_HINTS; ++h) {
+			for (unsigned r=0; r<2; ++r) {
+				RegionSamples::const_iterator fit = samples.find(200000 + (10*h+w)*1000 + (r+1)*100 + offset);
+				local[w][h][r] = fit == samples.end() ? 0 : median(fit->second.begin(), fit->second.end());
+			}
+		}
+	}
+	MPI_Gather(local, 4*NUM_HINTS, MPI_DOUBLE, times, 4*NUM_HINTS, MPI_DOUBLE, 0, pair_comm);
+
+	if (rank != 0) { return; }
+
+	for (unsigned w=0; w<2; ++w) {
+		double none = times[1][w][HINT_NONE][0] + times[1][w][HINT_NONE][1];
+		for (unsigned h=0; h<NUM_HINTS; ++h) {
+			double total = times[1][w][h][0] + times[1][w][h][1];
+			out << std::setw(12) << size
+				<< std::setw(8)  << (w ? "write" : "read")
+				<< std::setw(10) << hint_names[h]
+				<< std::setw(15) << times[0][w][h][0]
+				<< std::setw(15) << times[1][w][h][0]
+				<< std::setw(15) << times[1][w][h][1]
+				<< std::setw(15) << total
+				<< std::setw(12) << (total ? none / total : 0) << std::endl;
+		}
+	}
+}
+
+// One-way latency of the send/recv test: from the start of the send on rank 0 to the
+// completion of the receive on rank 1, in the timebase of rank 0. Samples of the two 
+// processes are paired by their order (collective operation, the table is written by
+// rank 0)
+void report_oneway(std::ostream& out, const RegionSamples& samples, const RegionSamples& starts, size_t size, double cpu_mhz) {
+	for (unsigned st=0; st<3; ++st) {
+		RegionCounter::RegionID id = 305200 + st*1000 + offset;
+		RegionSamples::const_iterator tit = samples.find(id), sit = starts.find(id);
+
+		std::vector<CounterValue> local;
+		if (tit != samples.end() && sit != starts.end()) {
+			for (size_t idx=0; idx<std::min(tit->second.size(), sit->second.size()); ++idx) {
+				// rank 0 starts, rank 1 completes
+				local.push_back( rank == 0 ? sit->second[idx] : sit->second[idx] + tit->second[idx] );
+			}
+		}
+
+		int count = local.size();
+		if (rank == 1) {
+			PMPI_Send(&count, 1, MPI_INT, 0, 2, pair_comm);
+			if (count) { PMPI_Send(&local.front(), count, MPI_LONG_LONG, 0, 2, pair_comm); }
+			continue;
+		}
+
+		int remote_count;
+		PMPI_Recv(&remote_count, 1, MPI_INT, 1, 2, pair_comm, MPI_STATUS_IGNORE);
+		std::vector<CounterValue> remote(remote_count);
+		if (remote_count) { 
+			PMPI_Recv(&remote.front(), remote_count, MPI_LONG_LONG, 1, 2, pair_comm, MPI_STATUS_IGNORE); 
+		}
+
+		std::vector<double> latencies;
+		for (size_t idx=0; idx<std::min(local.size(), remote.size()); ++idx) {
+			double end = clock_sync->to_global(remote[idx], 1);
+			latencies.push_back( (end - local[idx]) / cpu_mhz );
+		}
+		if (latencies.empty()) { continue; }
+
+		out << std::setw(12) << size
+			<< std::setw(8)  << state_names[st]
+			<< std::setw(15) << median(latencies.begin(), latencies.end())
+			<< std::setw(15) << *std::min_element(latencies.begin(), latencies.end())
+			<< std::setw(15) << *std::max_element(latencies.begin(), latencies.end()) << std::endl;
+	}
+}
+
+// Names of the regions of the timeline: test/size
+struct TraceRegionName {
+	std::string operator()(unsigned long id) const {
+		std::ostringstream ss;
+		ss << region_name(region_base(id)) << "/" << region_size(id);
+		return ss.str();
+	}
+};
+
+// Converts the cycle counter of a rank into the timebase of rank 0 (identity without sync)
+struct TraceClock {
+	const ClockSync* 	sync;
+	int 				rank;
+
+	double operator()(long long local) const { return sync ? sync->to_global(local, rank) : local; }
+};
+
+/**
+ * Collects the timeline of both processes on rank 0 and writes it as Chrome trace JSON,
+ * must be called by both processes
+ */
+void report_trace(const std::string& file_name, const Tracer& tracer) {
+	std::vector<TraceRecord> local = tracer.records();
+	if (tracer.dropped()) {
+		std::cerr << "[R" << rank << "] WARNING: " << tracer.dropped() 
+				  << " oldest trace records overwritten, increase CB_TRACE_SIZE" << std::endl;
+	}
+
+	// records are sent as elements of their own type, the count fits an int for any trace size
+	MPI_Datatype record_type;
+	MPI_Type_contiguous(sizeof(TraceRecord), MPI_BYTE, &record_type);
+	MPI_Type_commit(&record_type);
+
+	int count = local.size();
+	if (rank == 1) {
+		PMPI_Send(&count, 1, MPI_INT, 0, 3, pair_comm);
+		if (count) { PMPI_Send(&local.front(), count, record_type, 0, 3, pair_comm); }
+		MPI_Type_free(&record_type);
+		return;
+	}
+
+	int remote_count;
+	PMPI_Recv(&remote_count, 1, MPI_INT, 1, 3, pair_comm, MPI_STATUS_IGNORE);
+	std::vector<TraceRecord> remote(remote_count);
+	if (remote_count) {
+		PMPI_Recv(&remote.front(), remote_count, record_type, 1, 3, pair_comm, MPI_STATUS_IGNORE);
+	}
+	MPI_Type_free(&record_type);
+
+	TraceClock clocks[2] = { { clock_sync, 0 }, { clock_sync, 1 } };
+	double origin = local.empty() ? 0 : local.front().start;
+	if (!remote.empty()) { origin = std::min(origin, clocks[1](remote.front().start)); }
+
+	double cpu_mhz = cycles_per_usec();
+	std::fstream out(file_name.c_str(), std::fstream::out | std::fstream::trunc);
+	bool first = true;
+	write_chrome_header(out);
+	write_chrome_events(out, local, 0, first, origin, cpu_mhz, TraceRegionName(), clocks[0]);
+	write_chrome_events(out, remote, 1, first, origin, cpu_mhz, TraceRegionName(), clocks[1]);
+	write_chrome_footer(out);
+	std::cout << "Trace of " << local.size() + remote.size() << " phases written to " << file_name << std::endl;
+}
+
+// Regions measured while the antagonists are running get this added to their ID
+#define INTERFERENCE_ID 1000000
+
+// Pairs of cold/hot regions (IDs without the size offset) utilized to show how much
+// of the hot cache advantage survives the interference
+struct HotColdPair {
+	RegionCounter::RegionID cold;
+	RegionCounter::RegionID hot;
+	const char* 			name;
+};
+
+void report_interference(std::ostream& out, const RegionSamples& samples, size_t size) {
+	const HotColdPair tests[] = {
+		{ 305200, 306200, "comm_read" },
+		{ 305200, 307200, "comm_write" },
+		{ 540200, 541200, "pingpong_read" },
+		{ 540200, 542200, "pingpong_write" },
+		{ 550200, 551200, "stream_read" },
+		{ 550200, 552200, "stream_write" },
+		{ 700200, 701200, "rcomp" },
+		{ 750200, 752200, "wcomp" },
+	};
+
+	for (size_t idx=0; idx<sizeof(tests)/sizeof(tests[0]); ++idx) {
+		double adv[2];
+		bool found = true;
+		for (unsigned loaded=0; loaded<2; ++loaded) {
+			RegionSamples::const_iterator cold = samples.find(tests[idx].cold+offset+loaded*INTERFERENCE_ID);
+			RegionSamples::const_iterator hot = samples.find(tests[idx].hot+offset+loaded*INTERFERENCE_ID);
+			if (cold == samples.end() || hot == samples.end()) { found = false; break; }
+			adv[loaded] = median(cold->second.begin(), cold->second.end()) / 
+						  median(hot->second.begin(), hot->second.end());
+		}
+		if (!found) { continue; }
+
+		out << std::setw(16) << tests[idx].name
+			<< std::setw(12) << size
+			<< std::setw(12) << adv[0]
+			<< std::setw(12) << adv[1];
+		// percentage of the speedup given by the hot cache which is still there under pressure
+		if (adv[0] > 1) {
+			out << std::setw(12) << 100 * (adv[1]-1) / (adv[0]-1);
+		} else {
+			out << std::setw(12) << "-";
+		}
+		out << std::endl;
+	}
+}
+
+// Bytes of message data moved by a region (ID without the size offset) per repetition, the
+// same factors of the transfer report. 0 when the region does not move a whole message
+// (aggregation, second half of a non blocking transfer, accesses to the received data)
+size_t region_bytes(RegionCounter::RegionID base, size_t size) {
+	RegionCounter::RegionID id = base % INTERFERENCE_ID;
+	const std::vector<TransferDesc>& tests = transfer_tests();
+	for (std::vector<TransferDesc>::const_iterator it=tests.begin(), end=tests.end(); it!=end; ++it) {
+		if (it->id == id) { return it->rounds * it->directions * size; }
+	}
+
+	unsigned test = id / 1000 % 1000, region = id / 100 % 10;
+	bool single = (test >= 305 && test <= 307 && region == 2) ||  // send/recv
+				  (test >= 408 && test <= 416 && region == 1) ||  // local copy baselines
+				  (test >= 600 && test <= 622 && region == 2) ||  // asymmetric states
+				  (test >= 200 && test <= 241 && region == 1) ||  // cache hints
+				  (test >= 700 && test <= 785 && test % 10 >= 3 && region == 1); // scenarios
+	return single ? size : 0;
+}
+
+// Energy per repetition of each region, per byte moved by the region and average power while
+// the region runs. The processes do not measure the same regions, the table covers the union
+// of them. When the processes run on different nodes the energy of both nodes is summed, on 
+// the same node it is the largest reading (collective operation, the table is written by rank 0)
+void report_energy(std::ostream& out, const RegionEnergy& energy, size_t size, double cpu_mhz) {
+	// union of the regions of both processes, the same ordered list on both
+	std::vector<RegionCounter::RegionID> ids;
+	for (RegionEnergy::const_iterator it=energy.begin(); it!=energy.end(); ++it) { ids.push_back(it->first); }
+	int counts[2], num_ids = ids.size();
+	MPI_Allgather(&num_ids, 1, MPI_INT, counts, 1, MPI_INT, pair_comm);
+	int displs[2] = { 0, counts[0] };
+	std::vector<RegionCounter::RegionID> all_ids(counts[0] + counts[1] + 1);
+	MPI_Allgatherv(ids.empty() ? NULL : &ids.front(), num_ids, MPI_UNSIGNED_LONG, 
+				   &all_ids.front(), counts, displs, MPI_UNSIGNED_LONG, pair_comm);
+	all_ids.pop_back();
+	std::sort(all_ids.begin(), all_ids.end());
+	all_ids.erase(std::unique(all_ids.begin(), all_ids.end()), all_ids.end());
+	if (all_ids.empty()) { return; }
+
+	// energy (pkg, dram) and repetitions (time, count) of each region, 0 where a process has no entry
+	const size_t num = all_ids.size();
+	std::vector<double> local(4*num), total(4*num);
+	for (size_t idx=0; idx<num; ++idx) {
+		RegionEnergy::const_iterator fit = energy.find(all_ids[idx]);
+		if (fit == energy.end()) { continue; }
+		local[2*idx] = fit->second.pkg;
+		local[2*idx+1] = fit->second.dram;
+		local[2*num+2*idx] = fit->second.time;
+		local[2*num+2*idx+1] = fit->second.count;
+	}
+	MPI_Reduce(&local[0], &total[0], 2*num, MPI_DOUBLE, energy_shared ? MPI_MAX : MPI_SUM, 0, pair_comm);
+	MPI_Reduce(&local[2*num], &total[2*num], 2*num, MPI_DOUBLE, MPI_MAX, 0, pair_comm);
+
+	if (rank != 0) { return; }
+
+	for (size_t idx=0; idx<num; ++idx) {
+		const double *en = &total[2*idx], *reps = &total[2*num+2*idx];
+		if (reps[0] == 0 || reps[1] == 0) { continue; }
+
+		// micro joules per repetition and micro joules per microsecond (watts)
+		double pkg = en[0] / reps[1], dram = en[1] / reps[1];
+		double usecs = reps[0] / cpu_mhz;
+		out << std::setw(28) << region_name(region_base(all_ids[idx]))
+			<< std::setw(12) << size
+			<< std::setw(15) << pkg / 1e6
+			<< std::setw(15) << dram / 1e6
+			<< std::setw(15);
+		size_t bytes = region_bytes(region_base(all_ids[idx]), size);
+		if (bytes) { out << (pkg + dram) / 1e6 / bytes; } else { out << "-"; }
+		out << std::setw(12) << (en[0] + en[1]) / usecs << std::endl;
+	}
+}
+
+/**
+ * Tests of the sweep, in the order in which they are executed
+ */
+std::vector<TestFunc> sweep_tests(size_t cache_line_size) {
+	TestFunc tests[] = {
+			//  &test_1,  &test_2,
+			&test_5,  &test_6, &test_7,
+			&test_8,  &test_9 , &test_10,
+			&test_11, &test_12, &test_13,
+			&test_14, &test_15, &test_16,
+			test_40, test_41, test_42,
+			test_50, test_51, test_52,
+#define BIDIR(snd) \
+			test_sendrecv<snd,STATE_COLD>, test_sendrecv<snd,STATE_READ>, test_sendrecv<snd,STATE_WRITE>, \
+			test_isendrecv<snd,STATE_COLD>, test_isendrecv<snd,STATE_READ>, test_isendrecv<snd,STATE_WRITE>,
+			BIDIR(STATE_COLD) BIDIR(STATE_READ) BIDIR(STATE_WRITE)
+#undef BIDIR
+#define ASYM(snd) \
+			test_asym<snd,STATE_COLD>, test_asym<snd,STATE_READ>, test_asym<snd,STATE_WRITE>,
+			ASYM(STATE_COLD) ASYM(STATE_READ) ASYM(STATE_WRITE)
+#undef ASYM
+#define AGG(k) \
+			test_aggregate<k,STATE_COLD>, test_aggregate<k,STATE_READ>, test_aggregate<k,STATE_WRITE>,
+			AGG(0) AGG(1) AGG(2) AGG(3) AGG(4) AGG(5) AGG(6)
+#undef AGG
+#define HINT(h) \
+			test_hint<h,0>, test_hint<h,1>,
+			HINT(HINT_NONE) HINT(HINT_PREFETCH_POST) HINT(HINT_PREFETCH_DONE) HINT(HINT_CLDEMOTE) HINT(HINT_NT_SEND)
+#undef HINT
+		};
+	std::vector<TestFunc> benchs(tests, tests + sizeof(tests)/sizeof(tests[0]));
+	add_scenarios(benchs, cache_line_size);
+	return benchs;
+}
+
+void measure(unsigned rep, std::ostream& logFile, const EventNames& evts, size_t cache_size, size_t cache_line_size, Interference* interference) 
+{
+	const std::vector<TestFunc>& benchs = sweep_tests(cache_line_size);
+
+	double cpu_mhz = cycles_per_usec();
+
+	// latency (usecs) and bandwidth (MB/s) of the ping-pong and streaming tests 
+	std::fstream transferFile;
+	if (rank == 0) {
+		transferFile.open("cache_bench.transfer.csv", std::fstream::out | std::fstream::trunc);
+		transferFile << std::setw(10) << "pattern" << std::setw(12) << "state" << std::setw(12) << "size"
+					 << std::setw(15) << "latency" << std::setw(15) << "bandwidth" << std::endl;
+	}
+
+	// time of the sender and of the receiver for each combination of buffer states
+	std::fstream asymFile;
+	if (rank == 0) {
+		asymFile.open("cache_bench.asym.csv", std::fstream::out | std::fstream::trunc);
+		asymFile << std::setw(12) << "size" << std::setw(10) << "sender" << std::setw(10) << "receiver"
+				 << std::setw(15) << "snd_time" << std::setw(15) << "rcv_time" 
+				 << std::setw(12) << "snd_speedup" << std::setw(12) << "rcv_speedup" << std::endl;
+	}
+
+	// MPI time against the fastest local copy of the same buffer
+	std::fstream baselineFile;
+	if (rank == 0) {
+		baselineFile.open("cache_bench.baseline.csv", std::fstream::out | std::fstream::trunc);
+		baselineFile << std::setw(12) << "size" << std::setw(8) << "state" << std::setw(15) << "mpi"
+					 << std::setw(15) << "memcpy" << std::setw(15) << "ntcopy" << std::setw(15) << "handoff" 
+					 << std::setw(15) << "overhead" << std::endl;
+	}
+
+	std::fstream energyFile;
+	if (rank == 0 && energy_meter.is_enabled()) {
+		energyFile.open("cache_bench.energy.csv", std::fstream::out | std::fstream::trunc);
+		energyFile << std::setw(28) << "test" << std::setw(12) << "size" << std::setw(15) << "pkg_j" 
+				   << std::setw(15) << "dram_j" << std::setw(15) << "j_per_byte" << std::setw(12) << "power_w" << std::endl;
+	}
+
+	// one-way latency of the send/recv test in the synchronized timebase
+	std::fstream onewayFile;
+	if (rank == 0 && clock_sync) {
+		onewayFile.open("cache_bench.oneway.csv", std::fstream::out | std::fstream::trunc);
+		onewayFile << std::setw(12) << "size" << std::setw(8) << "state" << std::setw(15) << "latency" 
+				   << std::setw(15) << "min" << std::setw(15) << "max" << std::endl;
+	}
+
+	// K sends against one packed send of the same payload
+	std::fstream aggregationFile;
+	if (rank == 0) {
+		aggregationFile.open("cache_bench.aggregation.csv", std::fstream::out | std::fstream::trunc);
+		aggregationFile << std::setw(12) << "size" << std::setw(8) << "state" << std::setw(6) << "K"
+						<< std::setw(15) << "many" << std::setw(15) << "packed" << std::setw(12) << "speedup"
+						<< std::setw(8) << "best" << std::endl;
+	}
+
+	// sender and receiver time of the transfer of a message accessed after the receive, 
+	// for every cache hint
+	std::fstream hintFile;
+	if (rank == 0) {
+		hintFile.open("cache_bench.hints.csv", std::fstream::out | std::fstream::trunc);
+		hintFile << std::setw(12) << "size" << std::setw(8) << "access" << std::setw(10) << "hint"
+				 << std::setw(15) << "snd_time" << std::setw(15) << "rcv_time" << std::setw(15) << "access_time"
+				 << std::setw(15) << "rcv_total" << std::setw(12) << "speedup" << std::endl;
+	}
+
+	// hot cache advantage (cold/hot time ratio) on an idle machine and with the antagonists
+	std::fstream interferenceFile;
+	if (rank == 0 && interference) {
+		interferenceFile.open("cache_bench.interference.csv", std::fstream::out | std::fstream::trunc);
+		interferenceFile << std::setw(16) << "test" << std::setw(12) << "size" << std::setw(12) << "adv_idle"
+						 << std::setw(12) << "adv_loaded" << std::setw(12) << "survived" << std::endl;
+	}
+
+	offset = 0; 
+
+	MPI_Barrier(pair_comm);
+	!rank && std::cout << "~~~> Benchmark STARTS <~~~" << std::endl;
+	!rank && std::cout << "     + Don't move and hold your breath" << std::endl;
+
+	for (register size_t size = 64; size <= cache_size*4; size*=2) {
+		
+		MPI_Barrier(pair_comm);
+		!rank && std::cout << "Measuring for size: " << size << std::endl;
+		
+		++offset;
+
+		// the array is split into: msg | buff | receive buffer of the bidirectional tests
+		size_t buff_size = std::max(cache_size, size);
+		volatile char* msg = new char[ 3 * buff_size ];
+		// printf("BUFF: %x - %x\n", buff, (buff + buff_size));
+
+		volatile char* buff  = &msg[ buff_size ];
+		// printf("MSG: %x - %x\n", msg, (msg + buff_size));
+		memset((char*)msg, 2, sizeof(char) * 3 * buff_size);
+
+		// With interference the tests are executed twice, first on the idle machine and then 
+		// alongside the antagonists
+		// the clocks drift, the synchronization is repeated for every size
+		if (clock_sync) { clock_sync->sync(pair_comm); }
+
+		RegionSamples samples, starts;
+		RegionEnergy energy;
+		for (unsigned loaded=0; loaded<(interference ? 2 : 1); ++loaded) {
+			if (loaded) {
+				MPI_Barrier(pair_comm);
+				interference->start();
+				offset += INTERFERENCE_ID;
+			}
+
+			for(size_t idx=0; idx<benchs.size(); ++idx) {
+				measure(logFile, evts, BenchBinder(benchs[idx], msg, buff, cache_size, size, cache_line_size), rep, &samples,
+						energy_meter.is_enabled() ? &energy : NULL, clock_sync ? &starts : NULL);
+				!rank && std::cout << (loaded ? "#" : "%") << std::flush;
+			}
+			!rank && std::cout << std::endl;
+
+			if (loaded) {
+				offset -= INTERFERENCE_ID;
+				interference->stop();
+			}
+		}
+
+		if (rank == 0) { report_transfers(transferFile, samples, size, cpu_mhz); }
+		report_asymmetric(asymFile, samples, size);
+		report_baselines(baselineFile, samples, size);
+		report_aggregation(aggregationFile, samples, size);
+		report_hints(hintFile, samples, size);
+		if (clock_sync) { report_oneway(onewayFile, samples, starts, size, cpu_mhz); }
+		if (rank == 0 && interference) { report_interference(interferenceFile, samples, size); }
+		if (energy_meter.is_enabled()) { report_energy(energyFile, energy, size, cpu_mhz); }
+
+		delete[] msg;
+	}
+}
+
+//=============================================================================
+// Protocol threshold detection: samples a communication test at arbitrary sizes
+// and reduces the results among the 2 processes so that both ranks take the same
+// decisions during the bisection
+//=============================================================================
+struct ProtocolSampler {
+
+	TestFunc 		func_ptr;
+	volatile char*	msg_ptr;
+	volatile char*  buff_ptr;
+	size_t 			cache_size;
+	unsigned 		cache_line;
+	EventNames		evts;
+	unsigned 		rep;
+
+	ProtocolSampler(const TestFunc& func_ptr, 
+					volatile char* msg_ptr, 
+					volatile char* buff_ptr, 
+					size_t cache_size, 
+					unsigned cache_line,
+					const EventNames& evts,
+					unsigned rep) 
+		: func_ptr(func_ptr), msg_ptr(msg_ptr), buff_ptr(buff_ptr), cache_size(cache_size),
+		  cache_line(cache_line), evts(evts), rep(rep) { }
+
+	ProtocolPoint operator()(size_t size) const {
+		std::vector<CounterValue> times, misses;
+
+		BenchBinder bench(func_ptr, msg_ptr, buff_ptr, cache_size, size, cache_line);
+		for (unsigned idx=0; idx<rep; ++idx) {
+			RegionCounter reg(evts);
+			bench(reg);
+			while(!reg.next()) { bench(reg); }
+
+			const std::vector<RegionCounter::RegionCounters>& values = reg.values();
+			assert(values.size() == 1 && "Protocol detection needs tests with a single region");
+			times.push_back( values.front().time );
+			misses.push_back( values.front().values.empty() ? 0 : values.front().values.front() );
+		}
+
+		double local_time = median(times.begin(), times.end());
+		double local_misses = median(misses.begin(), misses.end());
+
+		ProtocolPoint p;
+		p.size = size;
+		MPI_Allreduce(&local_time, &p.time, 1, MPI_DOUBLE, MPI_MAX, pair_comm);
+		MPI_Allgather(&local_misses, 1, MPI_DOUBLE, p.misses, 1, MPI_DOUBLE, pair_comm);
+		return p;
+	}
+};
+
+void detect_protocol(unsigned rep, size_t cache_size, size_t cache_line_size) {
+
+	std::string llc_event = env_string("CB_LLC_EVENT", "PAPI_L3_TCM");
+	size_t max_size = env_size("CB_PROTOCOL_MAX", cache_size*4);
+	size_t resolution = std::max(env_size("CB_PROTOCOL_RESOLUTION", cache_line_size), cache_line_size);
+	double jump = env_double("CB_PROTOCOL_JUMP", 1.5);
+
+	struct { TestFunc func; const char* state; } tests[] = {
+		{ &test_5, "cold" }, 
+		{ &test_6, "hot" }
+	};
+
+	MPI_Barrier(pair_comm);
+	!rank && std::cout << "~~~> Protocol detection STARTS <~~~" << std::endl;
+	!rank && std::cout << "     + LLC event: " << llc_event << ", resolution: " << resolution << std::endl;
+
+	size_t buff_size = std::max(cache_size, max_size);
+	volatile char* msg = new char[ 2 * buff_size ];
+	volatile char* buff  = &msg[ buff_size ];
+	memset((char*)msg, 2, sizeof(char) * 2 * buff_size);
+
+	std::fstream logFile;
+	if (rank == 0) {
+		logFile.open("cache_bench.protocol.csv", std::fstream::out | std::fstream::trunc);
+		print_protocol_header(logFile);
+		print_protocol_header(std::cout);
+	}
+
+	for (size_t idx=0; idx<sizeof(tests)/sizeof(tests[0]); ++idx) {
+		ProtocolSampler sampler(tests[idx].func, msg, buff, cache_size, cache_line_size, EventNames(1, llc_event), rep);
+		const ProtocolThresholds& ths = detect_protocol_thresholds(sampler, 64, max_size, resolution, jump);
+
+		if (rank == 0) {
+			print_protocol_thresholds(logFile, tests[idx].state, ths);
+			print_protocol_thresholds(std::cout, tests[idx].state, ths);
+		}
+	}
+
+	delete[] msg;
+}
+
+//=============================================================================
+// Sampling mode: the communication tests are executed with an overflow handler
+// on the given event and the sampled instructions are attributed to functions
+// of the loaded objects (MPI library, libc, ...)
+//=============================================================================
+void report_hotspots(std::ostream& out, const OverflowSampler& sampler, size_t top) {
+	typedef std::map<std::pair<std::string,std::string>, size_t> Functions;
+	std::map<RegionCounter::RegionID, Functions> tests;
+	std::map<RegionCounter::RegionID, size_t> totals;
+	std::map<void*, std::pair<std::string,std::string> > symbols;
+
+	for (size_t idx=0; idx<sampler.size(); ++idx) {
+		const OverflowSampler::Sample& s = sampler[idx];
+		std::map<void*, std::pair<std::string,std::string> >::iterator sit = symbols.find(s.address);
+		if (sit == symbols.end()) {
+			sit = symbols.insert( std::make_pair(s.address, std::make_pair(object_name(s.address), symbol_name(s.address))) ).first;
+		}
+		RegionCounter::RegionID test = region_base(s.region);
+		++tests[test][sit->second];
+		++totals[test];
+	}
+
+	out << std::setw(28) << "test" << std::setw(10) << "samples" << std::setw(10) << "percent"
+		<< std::setw(30) << "object" << "  " << "function" << std::endl;
+
+	for (std::map<RegionCounter::RegionID, Functions>::const_iterator it=tests.begin(); it!=tests.end(); ++it) {
+		std::vector<std::pair<size_t, std::pair<std::string,std::string> > > funcs;
+		for (Functions::const_iterator fit=it->second.begin(); fit!=it->second.end(); ++fit) {
+			funcs.push_back( std::make_pair(fit->second, fit->first) );
+		}
+		std::sort(funcs.rbegin(), funcs.rend());
+
+		for (size_t idx=0; idx<std::min(top, funcs.size()); ++idx) {
+			out << std::setw(28) << region_name(it->first)
+				<< std::setw(10) << funcs[idx].first
+				<< std::setw(10) << std::fixed << std::setprecision(1) << 100.0 * funcs[idx].first / totals[it->first]
+				<< std::setw(30) << funcs[idx].second.first << "  " << funcs[idx].second.second << std::endl;
+			out.unsetf(std::ios::floatfield);
+			out.precision(6);
+		}
+	}
+}
+
+void sample_mpi(unsigned rep, size_t cache_size, size_t cache_line_size) {
+
+	std::string event = env_string("CB_SAMPLE_EVENT", "PAPI_L3_TCM");
+	int threshold = std::max<size_t>(env_size("CB_SAMPLE_THRESHOLD", 1000), 1);
+	size_t top = env_size("CB_SAMPLE_TOP", 10);
+
+	TestFunc tests[] = {
+		&test_5,  &test_6,  &test_7,
+		&test_40, &test_41, &test_42,
+		&test_50, &test_51, &test_52
+	};
+
+	MPI_Barrier(pair_comm);
+	!rank && std::cout << "~~~> Sampling STARTS <~~~" << std::endl;
+	!rank && std::cout << "     + Event: " << event << ", threshold: " << threshold << std::endl;
+
+	// both processes give up if the event cannot be sampled on either of them
+	OverflowSampler sampler(event, threshold);
+	int supported = 1, all_supported;
+	try {
+		PapiWrap papi;
+		sampler.arm();
+		sampler.disarm();
+	} catch (const std::logic_error& e) {
+		std::cerr << "[R" << rank << "] " << e.what() << std::endl;
+		supported = 0;
+	}
+	MPI_Allreduce(&supported, &all_supported, 1, MPI_INT, MPI_LAND, pair_comm);
+	if (!all_supported) { return; }
+
+	offset = 0;
+
+	for (size_t size = 64; size <= cache_size*4; size*=2) {
+		++offset;
+
+		size_t buff_size = std::max(cache_size, size);
+		volatile char* msg = new char[ 3 * buff_size ];
+		volatile char* buff  = &msg[ buff_size ];
+		memset((char*)msg, 2, sizeof(char) * 3 * buff_size);
+
+		for (size_t idx=0; idx<sizeof(tests)/sizeof(tests[0]); ++idx) {
+			BenchBinder bench(tests[idx], msg, buff, cache_size, size, cache_line_size);
+			for (unsigned r=0; r<rep; ++r) {
+				RegionCounter reg((EventNames()));
+				reg.attach(&sampler);
+				bench(reg);
+			}
+			!rank && std::cout << "%" << std::flush;
+		}
+		!rank && std::cout << std::endl;
+
+		delete[] msg;
+	}
+
+	std::ostringstream fileName;
+	fileName << "cache_bench.samples.r" << rank << ".csv";
+	std::fstream out(fileName.str().c_str(), std::fstream::out | std::fstream::trunc);
+	report_hotspots(out, sampler, top);
+
+	if (sampler.dropped()) {
+		std::cerr << "[R" << rank << "] WARNING: " << sampler.dropped() << " samples dropped, increase CB_SAMPLE_THRESHOLD" << std::endl;
+	}
+	if (rank == 0) { report_hotspots(std::cout, sampler, top); }
+}
+
+/**
+ * Header of a result file, the optional columns depend on the enabled features
+ */
+void write_log_header(std::ostream& logFile, const EventNames& evts, size_t length) {
+	logFile << std::setw(8) << "id" << std::setw(10) << "time";
+	if (verifier.is_enabled()) { logFile << std::setw(8) << "state" << std::setw(6) << "valid"; }
+	if (noise.is_enabled()) { 
+		logFile << std::setw(10) << "os_ctxsw" << std::setw(10) << "os_migr" << std::setw(10) << "os_faults" 
+				<< std::setw(10) << "os_freq"; 
+	}
+	if (energy_meter.is_enabled()) { logFile << std::setw(10) << "en_pkg" << std::setw(10) << "en_dram"; }
+
+	for(EventNames::const_iterator it=evts.begin(), end=evts.end(); it!=end; ++it) { logFile << std::setw(length) << *it; }
+	logFile << std::flush << std::endl;
+}
+
+// Optional columns written by write_log_header (part of the signature of a campaign)
+std::string optional_columns() {
+	std::string cols;
+	if (verifier.is_enabled()) { cols += ",verify"; }
+	if (noise.is_enabled()) { cols += ",noise"; }
+	if (energy_meter.is_enabled()) { cols += ",rapl"; }
+	return cols.empty() ? "none" : cols.substr(1);
+}
+
+//=============================================================================
+// Campaign: the sweep is split into work items (test x size x event group) served
+// to the pairs of processes by a coordinator (the last process of the world).
+// The coordinator checkpoints the completed items, a new run of the same campaign
+// skips them. Pairs are made of consecutive processes (2p, 2p+1)
+//=============================================================================
+#define CAMPAIGN_TAG 100
+
+/**
+ * Shape of the campaign of the first pair (signature), from world rank 0 to every process
+ * (collective operation on the world, the coordinator included)
+ */
+CampaignShape broadcast_campaign(const CampaignShape& local) {
+	std::string sig = local.signature();
+	unsigned length = sig.size();
+	MPI_Bcast(&length, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+	sig.resize(length);
+	MPI_Bcast(&sig[0], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+	return CampaignShape::from_signature(sig);
+}
+
+/**
+ * Serves the work items to the pairs until the queue is empty, the result files are merged
+ * once every item of the campaign is done
+ */
+void campaign_coordinator(int world_size) {
+	const CampaignShape& shape = broadcast_campaign(CampaignShape(0, 0, 0, 0, "", EventNames()));
+	const std::string& dir = env_string("CB_CAMPAIGN_DIR", "cache_bench.campaign");
+
+	CampaignCheckpoint* checkpoint = NULL;
+	try {
+		checkpoint = new CampaignCheckpoint(dir, shape);
+	} catch(const std::exception& e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	CampaignCheckpoint& ckpt = *checkpoint;
+
+	// the largest sizes first, the longest items do not trail at the end of the campaign
+	std::deque<unsigned> queue;
+	for (unsigned size=shape.sizes; size-- > 0; ) {
+		for (unsigned test=0; test<shape.tests; ++test) {
+			for (unsigned group=0; group<shape.groups; ++group) {
+				unsigned item = shape.item(test, size, group);
+				if (!ckpt.is_done(item)) { queue.push_back(item); }
+			}
+		}
+	}
+	unsigned pairs = (world_size-1) / 2;
+	std::cout << "[campaign] " << shape.items() << " items (" << shape.tests << " tests, " << shape.sizes << " sizes, " 
+			  << shape.groups << " groups of " << shape.events.size() << " events), " << ckpt.get_num_done() << " already done, " << pairs << " pairs" << std::endl;
+
+	for (unsigned active=pairs; active; ) {
+		// a pair reports the item it completed (-1 if none) and gets the next one
+		long item;
+		MPI_Status status;
+		MPI_Recv(&item, 1, MPI_LONG, MPI_ANY_SOURCE, CAMPAIGN_TAG, MPI_COMM_WORLD, &status);
+		if (item >= 0) {
+			ckpt.mark_done(item);
+			std::cout << "[campaign] item " << item << " done by pair " << status.MPI_SOURCE/2 << " (" 
+					  << ckpt.get_num_done() << "/" << shape.items() << ")" << std::endl;
+		}
+
+		long next = -1;
+		if (!queue.empty()) {
+			next = queue.front();
+			queue.pop_front();
+		} else {
+			--active;
+		}
+		MPI_Send(&next, 1, MPI_LONG, status.MPI_SOURCE, CAMPAIGN_TAG, MPI_COMM_WORLD);
+	}
+
+	size_t missing = shape.items() - ckpt.get_num_done();
+	delete checkpoint;
+	if (missing) {
+		std::cerr << "[campaign] " << missing << " items not done, run the campaign again" << std::endl;
+		return;
+	}
+	try {
+		merge_campaign(dir, shape, 0, "cache_bench.r0.csv");
+		merge_campaign(dir, shape, 1, "cache_bench.r1.csv");
+	} catch(const std::exception& e) {
+		std::cerr << "[campaign] ERROR: " << e.what() << std::endl;
+		return;
+	}
+	std::cout << "[campaign] completed, results merged into cache_bench.r0.csv and cache_bench.r1.csv" << std::endl;
+}
+
+/**
+ * Measures the work items given by the coordinator, the results of every item are written
+ * into the campaign directory (collective operation on the world)
+ */
+void campaign(unsigned rep, EventNames evts, size_t cache_size, size_t cache_line_size, size_t length, int coordinator) {
+	const std::vector<TestFunc>& tests = sweep_tests(cache_line_size);
+
+	unsigned sizes = 0;
+	for (size_t size = 64; size <= cache_size*4; size*=2) { ++sizes; }
+	size_t group_size = std::max<size_t>(env_size("CB_CAMPAIGN_EVENTS", 4), 1);
+	unsigned groups = std::max<size_t>((evts.size() + group_size-1) / group_size, 1);
+
+	// every pair measures the events of the first one, the shape has to be the same
+	const CampaignShape& shape = broadcast_campaign(CampaignShape(tests.size(), sizes, groups, rep, optional_columns(), evts));
+	if (shape.columns != optional_columns() || shape.repetitions != rep || shape.tests != tests.size()) {
+		std::cerr << "[R" << rank << "] ERROR: the pair does not match the campaign (" << shape.signature() << ")" << std::endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	evts = shape.events;
+	group_size = (evts.size() + shape.groups-1) / shape.groups;
+	const std::string& dir = env_string("CB_CAMPAIGN_DIR", "cache_bench.campaign");
+
+	long item = -1;
+	for (;;) {
+		if (rank == 0) {
+			MPI_Send(&item, 1, MPI_LONG, coordinator, CAMPAIGN_TAG, MPI_COMM_WORLD);
+			MPI_Recv(&item, 1, MPI_LONG, coordinator, CAMPAIGN_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		}
+		MPI_Bcast(&item, 1, MPI_LONG, 0, pair_comm);
+		if (item < 0) { break; }
+
+		unsigned test = shape.test_of(item), group = shape.group_of(item);
+		size_t size = 64 << shape.size_of(item);
+		offset = shape.size_of(item) + 1;
+		EventNames group_evts(evts.begin() + std::min(evts.size(), group*group_size), 
+							  evts.begin() + std::min(evts.size(), (group+1)*group_size));
+
+		!rank && std::cout << "Item " << item << ": test " << test << ", size " << size << ", events " 
+						   << group_evts.size() << std::endl;
+
+		std::fstream logFile(CampaignCheckpoint::item_file(dir, item, rank).c_str(), std::fstream::out | std::fstream::trunc);
+		write_log_header(logFile, group_evts, length);
+
+		size_t buff_size = std::max(cache_size, size);
+		volatile char* msg = new char[ 3 * buff_size ];
+		volatile char* buff  = &msg[ buff_size ];
+		memset((char*)msg, 2, sizeof(char) * 3 * buff_size);
+
+		if (clock_sync) { clock_sync->sync(pair_comm); }
+		measure(logFile, group_evts, BenchBinder(tests[test], msg, buff, cache_size, size, cache_line_size), rep);
+
+		delete[] msg;
+		logFile.close();
+
+		// the item is reported once the files of both processes are complete
+		MPI_Barrier(pair_comm);
+	}
+}
+
+//=============================================================================
+// Placement of the processes of a node. The pairs of a campaign may share the node: the
+// k-th pair on the node takes the cores of the sweep shifted by k, the helper threads of the
+// handoff the closest free core to their process and the coordinator the highest free core
+//=============================================================================
+
+// Cores of the helper thread and of the coordinator, -1 if no core is free
+struct NodeCores {
+	int handoff;
+	int spare;
+};
+
+/**
+ * Position of the pair among the pairs with a process on this node, the coordinator passes
+ * -1 (collective operation on the processes of the node)
+ */
+unsigned pair_slot(MPI_Comm node_comm, int pair) {
+	int node_size;
+	MPI_Comm_size(node_comm, &node_size);
+	std::vector<int> pairs(node_size);
+	MPI_Allgather(&pair, 1, MPI_INT, &pairs.front(), 1, MPI_INT, node_comm);
+
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+	pairs.erase(std::remove(pairs.begin(), pairs.end(), -1), pairs.end());
+	return pair < 0 ? 0 : std::lower_bound(pairs.begin(), pairs.end(), pair) - pairs.begin();
+}
+
+/**
+ * Core closest to the given one which is not utilized on the node, -1 if none
+ */
+int free_core_near(int core, const std::vector<bool>& used) {
+	const int num_cores = used.size();
+	for (int dist=1; dist<num_cores; ++dist) {
+		const int candidates[2] = { core - dist, core + dist };
+		for (unsigned idx=0; idx<2; ++idx) {
+			int c = candidates[idx];
+			if (c >= 0 && c < num_cores && !used[c]) { return c; }
+		}
+	}
+	return -1;
+}
+
+/**
+ * Checks that the pairs of the node and the requested helper threads do not share a core (the
+ * two processes of a pair only share it on a node with a single core), then assigns the helper
+ * threads without a requested core, in the order of the processes on the node, and the core of
+ * the coordinator. The coordinator passes -1 as pair and core, requested is -1 if not given.
+ * All the processes of the node get the same outcome, the errors are thrown by all of them
+ * (collective operation on the processes of the node)
+ */
+NodeCores place_on_node(MPI_Comm node_comm, int pair, int core, int requested, unsigned num_cores) {
+	int node_size, node_rank;
+	MPI_Comm_size(node_comm, &node_size);
+	MPI_Comm_rank(node_comm, &node_rank);
+	int mine[3] = { pair, core, requested };
+	std::vector<int> all(3*node_size);
+	MPI_Allgather(mine, 3, MPI_INT, &all.front(), 3, MPI_INT, node_comm);
+
+	// pair utilizing each core (-1 free), the requested helper threads after all the benchmark processes
+	std::vector<int> owner(num_cores, -1);
+	for (int idx=0; idx<2*node_size; ++idx) {
+		const bool helper = idx >= node_size;
+		const int* proc = &all[3*(idx % node_size)];
+		const int c = proc[helper ? 2 : 1];
+		if (proc[0] < 0 || c < 0) { continue; }
+		if (c >= static_cast<int>(num_cores) || (owner[c] >= 0 && (helper || owner[c] != proc[0]))) {
+			std::ostringstream ss;
+			ss << (helper ? "handoff thread" : "benchmark process") << " of pair " << proc[0] << " on core " << c 
+			   << (c >= static_cast<int>(num_cores) ? ", beyond the cores of the node" : ", which is utilized by another process");
+			throw std::logic_error(ss.str());
+		}
+		owner[c] = proc[0];
+	}
+
+	std::vector<bool> used(num_cores);
+	for (unsigned c=0; c<num_cores; ++c) { used[c] = owner[c] >= 0; }
+
+	NodeCores ret = { -1, -1 };
+	for (int p=0; p<node_size; ++p) {
+		const int* proc = &all[3*p];
+		if (proc[0] < 0) { continue; }
+		int handoff = proc[2];
+		if (handoff < 0) {
+			handoff = free_core_near(proc[1], used);
+			if (handoff >= 0) { used[handoff] = true; }
+		}
+		if (p == node_rank) { ret.handoff = handoff; }
+	}
+	for (int c=num_cores; c-- > 0; ) {
+		if (!used[c]) { ret.spare = c; break; }
+	}
+	return ret;
+}
+
+size_t read_counter_names(const std::string& file_name, std::vector<std::string>& counter_names) {
+	size_t max_lenght=0;
+	try {
+		std::ifstream file(file_name.c_str(), std::ifstream::in);
+
+		std::string line;
+		while(std::getline(file, line)) { 
+			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
+			counter_names.push_back(line); 
 			max_lenght = std::max(max_lenght, line.length());
 		}
 	}catch(std::exception e) { 
@@ -533,6 +2156,58 @@ int main (int argc, char* argv[]) {
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
 
+	// A campaign splits the world into pairs of benchmark processes, the last process 
+	// serves the work items
+	const int world_rank = rank, coordinator = comm_size-1;
+	const bool campaign_mode = env_string("CB_MODE", "sweep") == "campaign";
+	if (campaign_mode) {
+		if (comm_size < 3 || comm_size % 2 == 0) {
+			!rank && std::cerr << "ERROR: a campaign needs an odd number of processes (pairs and the coordinator)" << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		// the items measure the raw regions only, the sweep under interference and the
+		// tables derived from whole sizes are not part of a campaign
+		if (!env_string("CB_INTERFERENCE", "").empty()) {
+			!rank && std::cerr << "ERROR: CB_INTERFERENCE is not supported by a campaign" << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		!rank && std::cerr << "WARNING: a campaign writes only cache_bench.r*.csv, the transfer, asym, baseline, "
+						   << "aggregation, hints, oneway (CB_CLOCK_SYNC) and energy (CB_RAPL) tables are not written" << std::endl;
+		MPI_Comm_split(MPI_COMM_WORLD, rank == coordinator ? MPI_UNDEFINED : rank/2, rank, &pair_comm);
+	}
+	const bool is_coordinator = campaign_mode && rank == coordinator;
+
+	// The processes sharing the node are placed on distinct cores
+	MPI_Comm node_comm;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+	const unsigned slot = pair_slot(node_comm, is_coordinator ? -1 : world_rank/2);
+
+	if (is_coordinator) {
+		Info info(argc, argv);
+		NodeCores placed = { -1, -1 };
+		try {
+			placed = place_on_node(node_comm, -1, -1, -1, info.num_cores);
+		} catch(const std::exception& e) {
+			std::cerr << "[campaign] ERROR: " << e.what() << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		if (placed.spare >= 0) {
+			size_t core = placed.spare;
+			set_process_affinity(0, &core);
+			std::cout << "[campaign] Coordinator on core: " << core << std::endl;
+		} else {
+			std::cerr << "[campaign] WARNING: no free core for the coordinator, it is not pinned" << std::endl;
+		}
+		campaign_coordinator(comm_size);
+		MPI_Comm_free(&node_comm);
+		MPI_Finalize();
+		return 0;
+	}
+	if (campaign_mode) {
+		MPI_Comm_rank(pair_comm, &rank);
+		MPI_Comm_size(pair_comm, &comm_size);
+	}
+
 
 	// Read the PAPI_HOME environment variable 
 	std::string PAPI_HOME = getenv("PAPI_HOME") ? getenv("PAPI_HOME") : "";
@@ -545,10 +2220,13 @@ int main (int argc, char* argv[]) {
 	// Read the available events from PAPI
 	char rankStr[30];
 	sprintf(rankStr, "%d", rank);
-	std::string fileName = std::string("/tmp/hw_counters_") + rankStr + ".txt";
+	// the pairs of a campaign may share the node
+	std::ostringstream counterFile;
+	counterFile << "/tmp/hw_counters_" << world_rank << ".txt";
+	std::string fileName = counterFile.str();
 	system((PAPI_HOME + "papi_avail -a | grep ^PAPI_| cut -d \" \" -f 1 > " + fileName).c_str());
 
-	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_Barrier(pair_comm);
 
 	// get the hostname of the two processes
 	char hostname[30];
@@ -560,12 +2238,12 @@ int main (int argc, char* argv[]) {
 		hosts = new char[comm_size][30];
 	}
 
-	MPI_Gather(hostname, 30, MPI_CHAR, hosts, 30, MPI_CHAR, 0, MPI_COMM_WORLD);
+	MPI_Gather(hostname, 30, MPI_CHAR, hosts, 30, MPI_CHAR, 0, pair_comm);
 	int sameHost=0;
 	if (rank==0 && (std::string(hosts[0]) == std::string(hosts[1]))) {
 		sameHost=1;
 	}
-	MPI_Bcast(reinterpret_cast<void*>(&sameHost), 1, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Bcast(reinterpret_cast<void*>(&sameHost), 1, MPI_INT, 0, pair_comm);
 
 	std::cout << "[R" << rank << "]: Same host " << sameHost << std::endl;
 
@@ -578,15 +2256,17 @@ int main (int argc, char* argv[]) {
 
 	std::cout << "Number of PAPI counters: " << evts.size() << std::endl;
 
-	// open log files
+	// open log files (the results of a campaign go to the files of its items)
 	std::string logFileName = std::string("cache_bench.r") + rankStr + ".csv";
-	std::fstream logFile(logFileName.c_str(), std::fstream::out | std::fstream::trunc);
+	std::fstream logFile;
+	if (!campaign_mode) { logFile.open(logFileName.c_str(), std::fstream::out | std::fstream::trunc); }
 
 	Info info(argc, argv);
 
 	if (rank == 0) {
 		std::cout << "@@ Num cores: " << info.num_cores << std::endl;
 		std::cout << "@@ Num sockets: " << info.num_sockets << std::endl;
+		std::cout << "@@ Cache line: " << info.cache_line << std::endl;
 	}
 
 	size_t cache_size = info.cache_sizes[info.levels-1];
@@ -607,14 +2287,56 @@ int main (int argc, char* argv[]) {
 		affinity = info.num_cores/info.num_sockets;
 	}
 
-	std::cout << "[R" << rank <<"] Affinity set to: {0, " << affinity << "}" << std::endl;
+	// the k-th pair on the node is shifted by k cores (towards the middle when mirrored), a
+	// shift beyond the cores of the node is rejected by the placement
+	size_t cores[2] = { slot, sameHost==1 && info.num_sockets==1 ? 
+								(affinity >= slot ? affinity - slot : info.num_cores) : affinity + slot };
+	std::cout << "[R" << rank <<"] Affinity set to: {" << cores[0] << ", " << cores[1] << "}" << std::endl;
 
-	set_process_affinity(rank, (size_t[2]){ 0, affinity });
+	// The helper thread of the handoff baseline runs next to the benchmark process, never on
+	// the core of another process of the node
+	std::vector<unsigned> handoff_cores = parse_cores(env_string("CB_HANDOFF_CORES", ""));
+	NodeCores placed = { -1, -1 };
+	try {
+		placed = place_on_node(node_comm, world_rank/2, cores[rank], 
+							   handoff_cores.size() == 2 ? handoff_cores[rank] : -1, info.num_cores);
+	} catch(const std::exception& e) {
+		std::cerr << "[R" << world_rank << "] ERROR: " << e.what() << std::endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	MPI_Comm_free(&node_comm);
 
-	logFile << std::setw(8) << "id" << std::setw(10) << "time";
+	set_process_affinity(rank, cores);
 
-	for(EventNames::const_iterator it=evts.begin(), end=evts.end(); it!=end; ++it) { logFile << std::setw(length) << *it; }
-	logFile << std::flush << std::endl;
+	if (env_flag("CB_VERIFY")) {
+		verifier.enable(info.cache_line, env_size("CB_VERIFY_RETRIES", 3), env_double("CB_VERIFY_THRESHOLD", 0));
+		std::cout << "[R" << rank << "] Cache state verification, threshold: " << verifier.get_threshold() << " cycles" << std::endl;
+	}
+
+	if (env_flag("CB_NOISE")) {
+		noise.enable(env_double("CB_NOISE_FREQ_TOLERANCE", 0.1));
+		noise_discard = env_flag("CB_NOISE_DISCARD");
+		noise_retries = env_size("CB_NOISE_RETRIES", noise_retries);
+		RegionCounter::set_noise_monitor(&noise);
+		std::cout << "[R" << rank << "] OS noise detection with " << (noise.has_perf() ? "perf events" : "getrusage")
+				  << ", reference frequency ratio: " << noise.get_reference() << std::endl;
+	}
+
+	if (env_flag("CB_RAPL")) {
+		std::string root = env_string("CB_RAPL_ROOT", "/sys/class/powercap");
+		int found = energy_meter.enable(root), all_found;
+		MPI_Allreduce(&found, &all_found, 1, MPI_INT, MPI_LAND, pair_comm);
+		if (all_found) {
+			energy_shared = sameHost;
+			RegionCounter::set_energy_meter(&energy_meter);
+			std::cout << "[R" << rank << "] RAPL energy from " << energy_meter.num_domains() << " domains in " << root << std::endl;
+		} else {
+			!rank && std::cerr << "WARNING: RAPL domains not found (or not readable) in " << root << std::endl;
+			energy_meter.disable();
+		}
+	}
+
+	if (!campaign_mode) { write_log_header(logFile, evts, length); }
 	
 	std::cout << "Cache size is: " << cache_size << std::endl;
 
@@ -622,13 +2344,96 @@ int main (int argc, char* argv[]) {
 	for(unsigned i=0; i<100; ++i) { 
 		int data=0;
 		if(rank==0) { 
-			MPI_Send(&data,1,MPI_INT,1,0,MPI_COMM_WORLD);
+			MPI_Send(&data,1,MPI_INT,1,0,pair_comm);
 		} else { 
-			MPI_Recv(&data,1,MPI_INT,0,0,MPI_COMM_WORLD, MPI_STATUS_IGNORE); 
+			MPI_Recv(&data,1,MPI_INT,0,0,pair_comm, MPI_STATUS_IGNORE); 
+		}
+	}
+
+	pingpong_iters = std::max<size_t>(env_size("CB_PINGPONG_ITERS", pingpong_iters), 1);
+	stream_window = std::max<size_t>(env_size("CB_STREAM_WINDOW", stream_window), 1);
+	requests.resize(std::max(stream_window, 2u));
+	agg_max_k = env_size("CB_AGG_MAX_K", agg_max_k);
+	prefetch_distance = env_size("CB_PREFETCH_DISTANCE", prefetch_distance);
+
+	if (env_flag("CB_CLOCK_SYNC")) {
+		clock_sync = new ClockSync(rank, env_size("CB_CLOCK_ROUNDS", 200));
+		clock_sync->sync(pair_comm);
+		!rank && std::cout << "Clock offset of R1: " << clock_sync->get_offset(PAPI_get_real_cyc()) 
+						   << " cycles, drift: " << clock_sync->get_drift() << std::endl;
+	}
+
+	// Both processes skip the handoff tests when either misses a free core, they synchronize
+	int has_handoff = placed.handoff >= 0, all_handoff;
+	MPI_Allreduce(&has_handoff, &all_handoff, 1, MPI_INT, MPI_LAND, pair_comm);
+	if (!all_handoff) {
+		std::cerr << "[R" << rank << "] WARNING: no free core for the handoff thread, tests 14-16 are skipped" << std::endl;
+	} else {
+		std::cout << "[R" << rank << "] Handoff thread on core: " << placed.handoff << std::endl;
+		handoff = new HandoffThread(placed.handoff);
+	}
+
+	// Antagonists are started by one process per node, the cores are node wide
+	Interference* interference = NULL;
+	std::string interference_mode = env_string("CB_INTERFERENCE", "");
+	if (!interference_mode.empty()) {
+		std::vector<unsigned> antagonist_cores = parse_cores(env_string("CB_INTERFERENCE_CORES", ""));
+		size_t footprint = env_size("CB_INTERFERENCE_FOOTPRINT", 
+				parse_antagonist_mode(interference_mode) == ANTAGONIST_BW ? cache_size*8 : cache_size);
+
+		for (size_t idx=0; idx<antagonist_cores.size(); ++idx) {
+			if (antagonist_cores[idx] == cores[0] || antagonist_cores[idx] == cores[1]) {
+				std::cerr << "[R" << rank << "] WARNING: antagonist on core " << antagonist_cores[idx] 
+						  << " shares the core with a benchmark process" << std::endl;
+			}
 		}
+		if (rank == 0 || sameHost == 0) {
+			interference = new Interference(parse_antagonist_mode(interference_mode), footprint, info.cache_line, antagonist_cores);
+		} else {
+			interference = new Interference(ANTAGONIST_IDLE, footprint, info.cache_line, std::vector<unsigned>());
+		}
+		!rank && std::cout << "Interference: " << interference_mode << " on " << antagonist_cores.size() 
+						   << " cores, footprint: " << footprint << std::endl;
+	}
+
+	Tracer* trace = NULL;
+	if (env_flag("CB_TRACE")) {
+		// the records of a process are sent to rank 0 with an int count
+		size_t trace_size = env_size("CB_TRACE_SIZE", 1<<20);
+		if (trace_size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+			std::cerr << "[R" << rank << "] ERROR: CB_TRACE_SIZE larger than " << std::numeric_limits<int>::max() << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		trace = new Tracer(trace_size);
+		tracer = trace;
+		RegionCounter::set_tracer(trace);
+	}
+
+	const std::string& mode = env_string("CB_MODE", "sweep");
+	if (mode == "protocol") {
+		detect_protocol(REPETITIONS, cache_size, info.cache_line);
+	} else if (mode == "sample") {
+		sample_mpi(REPETITIONS, cache_size, info.cache_line);
+	} else if (campaign_mode) {
+		campaign(REPETITIONS, evts, cache_size, info.cache_line, length, coordinator);
+	} else {
+		measure(REPETITIONS, logFile, evts, cache_size, info.cache_line, interference);
+	}
+
+	if (trace) {
+		tracer = NULL;
+		RegionCounter::set_tracer(NULL);
+		std::ostringstream traceFile;
+		traceFile << "cache_bench.trace";
+		if (campaign_mode) { traceFile << ".p" << world_rank/2; }
+		traceFile << ".json";
+		report_trace(traceFile.str(), *trace);
+		delete trace;
 	}
 
-	measure(REPETITIONS, logFile, evts, cache_size, 64);
+	delete interference;
+	delete handoff;
+	delete clock_sync;
 
 	logFile.close();
 	std::cout << g_val << std::endl;
@@ -0,0 +1,274 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Compares two runs of the benchmark (i.e. before and after an upgrade of the MPI library).
+ * Regions are matched by test, cache state and size, and the samples of the two runs are
+ * compared with the Mann-Whitney U test, the p-values are Holm corrected over the sizes
+ * of each region (test, cache state and region). The bootstrap confidence interval of the ratio of the medians is
+ * reported as effect size.
+ *
+ * Usage: cache_compare [--metric NAME] [--alpha P] [--threshold R] [--bootstrap N] [--all]
+ *                      old.csv new.csv
+ *
+ * Exits with 2 if at least one significant regression is larger than the threshold (relative
+ * change of the median, 0.05 by default). With the bootstrap (--bootstrap 0 disables it) the
+ * lower bound of the confidence interval must be larger than the threshold as well.
+ */
+
+#include "results.h"
+
+#include <iostream>
+#include <iomanip>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+struct Comparison {
+	RegionKey 	key;
+	size_t 		samples[2];
+	double 		median[2];
+	// relative change of the median, positive when new is slower (or counts more)
+	double 		change;
+	double 		ci_low;
+	double 		ci_high;
+	double 		p_value;
+	// Holm adjusted p-value, the family is the set of compared sizes of the region
+	double 		p_holm;
+	// probability that a sample of new is larger than a sample of old (0.5: no effect)
+	double 		effect;
+
+	Comparison(const RegionKey& key) : key(key), change(0), ci_low(0), ci_high(0), p_value(1), p_holm(1), effect(0.5) { }
+};
+
+static double median_of(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	return n % 2 ? v[n/2] : (v[n/2-1] + v[n/2]) / 2;
+}
+
+/**
+ * Two sided Mann-Whitney U test with the normal approximation (tie and continuity
+ * corrected). Returns the p-value and stores P(new > old) in effect.
+ */
+static double mann_whitney(const std::vector<double>& a, const std::vector<double>& b, double& effect) {
+	std::vector<std::pair<double,int> > all;
+	for (size_t i=0; i<a.size(); ++i) { all.push_back( std::make_pair(a[i], 0) ); }
+	for (size_t i=0; i<b.size(); ++i) { all.push_back( std::make_pair(b[i], 1) ); }
+	std::sort(all.begin(), all.end());
+
+	double n1 = a.size(), n2 = b.size(), n = n1 + n2;
+	double rank_b = 0, ties = 0;
+	for (size_t i=0; i<all.size(); ) {
+		size_t j = i;
+		while (j < all.size() && all[j].first == all[i].first) { ++j; }
+		double t = j - i, rank = (i + 1 + j) / 2.0; // average rank of the tied group
+		for (size_t k=i; k<j; ++k) { if (all[k].second) { rank_b += rank; } }
+		ties += t*t*t - t;
+		i = j;
+	}
+
+	double u = rank_b - n2 * (n2 + 1) / 2;
+	effect = u / (n1 * n2);
+
+	double sigma = sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+	if (sigma == 0) { return 1; }
+	double z = (fabs(u - n1 * n2 / 2) - 0.5) / sigma;
+	return z <= 0 ? 1 : erfc(z / sqrt(2.0));
+}
+
+/**
+ * Percentile bootstrap of the relative change of the median, with a fixed seed so that
+ * the report is reproducible
+ */
+static void bootstrap(const std::vector<double>& a, const std::vector<double>& b, unsigned iterations,
+		double alpha, double& low, double& high) {
+	unsigned seed = 12345;
+	std::vector<double> changes, ra(a.size()), rb(b.size());
+	for (unsigned it=0; it<iterations; ++it) {
+		for (size_t i=0; i<a.size(); ++i) { ra[i] = a[rand_r(&seed) % a.size()]; }
+		for (size_t i=0; i<b.size(); ++i) { rb[i] = b[rand_r(&seed) % b.size()]; }
+		double ma = median_of(ra);
+		if (ma != 0) { changes.push_back( median_of(rb) / ma - 1 ); }
+	}
+	if (changes.empty()) { low = high = 0; return; }
+
+	std::sort(changes.begin(), changes.end());
+	low = changes[ static_cast<size_t>(alpha / 2 * (changes.size()-1)) ];
+	high = changes[ static_cast<size_t>((1 - alpha / 2) * (changes.size()-1)) ];
+}
+
+/**
+ * Holm step-down adjustment within each family (the sizes of a region), controls the
+ * family-wise error rate of every region. Returns the size of the largest family
+ */
+static size_t holm_adjust(std::vector<Comparison>& comps) {
+	std::map<RegionID, std::vector<std::pair<double,size_t> > > families;
+	for (size_t idx=0; idx<comps.size(); ++idx) { 
+		families[comps[idx].key.base].push_back( std::make_pair(comps[idx].p_value, idx) ); 
+	}
+
+	size_t largest = 0;
+	for (std::map<RegionID, std::vector<std::pair<double,size_t> > >::iterator it=families.begin(); 
+			it != families.end(); ++it) {
+		std::vector<std::pair<double,size_t> >& order = it->second;
+		std::sort(order.begin(), order.end());
+		largest = std::max(largest, order.size());
+
+		double running = 0, m = order.size();
+		for (size_t idx=0; idx<order.size(); ++idx) {
+			running = std::max(running, std::min(1.0, (m - idx) * order[idx].first));
+			comps[ order[idx].second ].p_holm = running;
+		}
+	}
+	return largest;
+}
+
+/**
+ * Smallest p-value the test can give with the given number of samples (no overlap)
+ */
+static double min_p_value(size_t n1, size_t n2) {
+	std::vector<double> a, b;
+	for (size_t i=0; i<n1; ++i) { a.push_back(i); }
+	for (size_t i=0; i<n2; ++i) { b.push_back(n1 + i); }
+	double effect;
+	return mann_whitney(a, b, effect);
+}
+
+static const std::vector<double>* metric_samples(const ResultSet& res, const RegionKey& key, int column) {
+	if (column < 0) {
+		std::map<RegionKey, std::vector<double> >::const_iterator it = res.times.find(key);
+		return it == res.times.end() ? NULL : &it->second;
+	}
+	std::map<RegionKey, std::vector<std::vector<double> > >::const_iterator it = res.counters.find(key);
+	return it == res.counters.end() || it->second.size() <= static_cast<size_t>(column) ? NULL : &it->second[column];
+}
+
+static int column_of(const ResultSet& res, const std::string& metric) {
+	if (metric == "time") { return -1; }
+	std::vector<std::string>::const_iterator it = std::find(res.columns.begin(), res.columns.end(), metric);
+	if (it == res.columns.end()) { throw std::logic_error("Metric not found in the result file: " + metric); }
+	return it - res.columns.begin();
+}
+
+int main(int argc, char* argv[]) {
+
+	std::string metric = "time";
+	double alpha = 0.05, threshold = 0.05;
+	unsigned iterations = 1000;
+	bool all = false;
+	std::vector<std::string> files;
+
+	for (int idx=1; idx<argc; ++idx) {
+		std::string arg = argv[idx];
+		if (arg == "--metric" && idx+1 < argc) { metric = argv[++idx]; }
+		else if (arg == "--alpha" && idx+1 < argc) { alpha = strtod(argv[++idx], NULL); }
+		else if (arg == "--threshold" && idx+1 < argc) { threshold = strtod(argv[++idx], NULL); }
+		else if (arg == "--bootstrap" && idx+1 < argc) { iterations = strtoul(argv[++idx], NULL, 10); }
+		else if (arg == "--all") { all = true; }
+		else if (arg.compare(0, 2, "--") == 0) { files.clear(); break; }
+		else { files.push_back(arg); }
+	}
+
+	if (files.size() != 2 || alpha <= 0 || alpha >= 1) {
+		std::cerr << "Usage: " << argv[0] << " [--metric NAME] [--alpha P] [--threshold R] [--bootstrap N] [--all] "
+				  << "old.csv new.csv" << std::endl;
+		return 1;
+	}
+
+	std::vector<Comparison> comps;
+	try {
+		const ResultSet& old_res = load_results(files[0]);
+		const ResultSet& new_res = load_results(files[1]);
+		int old_col = column_of(old_res, metric), new_col = column_of(new_res, metric);
+
+		for (std::map<RegionKey, std::vector<double> >::const_iterator it = old_res.times.begin();
+				it != old_res.times.end(); ++it) {
+			const std::vector<double>* a = metric_samples(old_res, it->first, old_col);
+			const std::vector<double>* b = metric_samples(new_res, it->first, new_col);
+			if (!a || !b || a->size() < 2 || b->size() < 2) { continue; }
+
+			Comparison c(it->first);
+			c.samples[0] = a->size();
+			c.samples[1] = b->size();
+			c.median[0] = median_of(*a);
+			c.median[1] = median_of(*b);
+			c.change = c.median[0] != 0 ? c.median[1] / c.median[0] - 1 : 0;
+			c.p_value = mann_whitney(*a, *b, c.effect);
+			if (iterations) { bootstrap(*a, *b, iterations, alpha, c.ci_low, c.ci_high); }
+			comps.push_back(c);
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	size_t family = holm_adjust(comps);
+
+	// with few samples the test cannot reach the corrected level, no change can be detected
+	size_t min_samples[2] = { 0, 0 };
+	for (size_t idx=0; idx<comps.size(); ++idx) {
+		for (unsigned r=0; r<2; ++r) {
+			if (!min_samples[r] || comps[idx].samples[r] < min_samples[r]) { min_samples[r] = comps[idx].samples[r]; }
+		}
+	}
+	if (!comps.empty() && min_p_value(min_samples[0], min_samples[1]) * family > alpha) {
+		std::cerr << "WARNING: with " << min_samples[0] << " and " << min_samples[1] << " samples the smallest p-value is "
+				  << min_p_value(min_samples[0], min_samples[1]) << ", above alpha / " << family 
+				  << " (sizes per region): changes of such regions cannot be detected, increase the repetitions" << std::endl;
+	}
+
+	std::cout << std::setw(28) << "test" << std::setw(12) << "size" << std::setw(15) << "old"
+			  << std::setw(15) << "new" << std::setw(10) << "change" << std::setw(10) << "ci_low"
+			  << std::setw(10) << "ci_high" << std::setw(12) << "p" << std::setw(12) << "p_holm" << std::setw(10) << "effect"
+			  << std::setw(12) << "verdict" << std::endl;
+
+	unsigned regressions = 0, improvements = 0, failures = 0;
+	for (size_t idx=0; idx<comps.size(); ++idx) {
+		const Comparison& c = comps[idx];
+
+		std::string verdict = "-";
+		if (c.p_holm < alpha && c.change > 0) {
+			verdict = "regression";
+			++regressions;
+			if (c.change > threshold && (!iterations || c.ci_low > threshold)) { verdict = "FAIL"; ++failures; }
+		} else if (c.p_holm < alpha && c.change < 0) {
+			verdict = "improvement";
+			++improvements;
+		}
+		if (!all && verdict == "-") { continue; }
+
+		std::cout << std::setw(28) << region_name(c.key.base) << std::setw(12) << c.key.size
+				  << std::setw(15) << c.median[0] << std::setw(15) << c.median[1]
+				  << std::setw(10) << std::fixed << std::setprecision(3) << c.change
+				  << std::setw(10) << c.ci_low << std::setw(10) << c.ci_high
+				  << std::setw(12) << std::scientific << std::setprecision(2) << c.p_value << std::setw(12) << c.p_holm
+				  << std::setw(10) << std::fixed << std::setprecision(3) << c.effect
+				  << std::setw(12) << verdict << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << std::setprecision(6);
+	}
+
+	std::cout << std::endl << comps.size() << " regions compared on " << metric << ": "
+			  << regressions << " regressions (" << failures << " beyond " << threshold * 100 << "%), "
+			  << improvements << " improvements" << std::endl;
+
+	return failures ? 2 : 0;
+}
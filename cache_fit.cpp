@@ -0,0 +1,336 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Fits performance models to the per-size results of a sweep, for each test (and therefore
+ * for each cache state):
+ * 	- Hockney: T(n) = alpha + beta * n
+ * 	- piecewise Hockney, split at the protocol thresholds and at the cache capacities
+ * 	- LogGP (L, o, g, G) for the send/recv tests, requires the results of both ranks
+ *
+ * Usage: cache_fit [--json FILE] [--protocol FILE] [--cache SIZES] [--window N] r0.csv [r1.csv]
+ *
+ * The medians of the samples are fitted, times are in cycles (as in the result files).
+ */
+
+#include "options.h"
+#include "results.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+
+typedef std::vector<std::pair<double,double> > Points; // (size, median time)
+
+struct LinearFit {
+	double 	alpha;
+	double 	beta;
+	double 	r2;
+	// mean relative error of the prediction
+	double 	mre;
+	size_t 	from;
+	size_t 	to;
+	size_t 	points;
+
+	LinearFit() : alpha(0), beta(0), r2(0), mre(0), from(0), to(0), points(0) { }
+
+	double predict(double size) const { return alpha + beta * size; }
+};
+
+struct LogGP {
+	double L, o, g, G;
+};
+
+template <class Iter>
+static double median_of(Iter begin, Iter end) {
+	std::vector<double> v(begin, end);
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	return n % 2 ? v[n/2] : (v[n/2-1] + v[n/2]) / 2;
+}
+
+/**
+ * Least squares fit weighted with 1/T^2, which minimizes the relative error: small and
+ * large messages count the same even though their times differ by orders of magnitude
+ */
+static LinearFit hockney(Points::const_iterator begin, Points::const_iterator end) {
+	LinearFit fit;
+	fit.points = std::distance(begin, end);
+	if (fit.points == 0) { return fit; }
+	fit.from = static_cast<size_t>(begin->first);
+	fit.to = static_cast<size_t>((end-1)->first);
+
+	double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for (Points::const_iterator it = begin; it != end; ++it) {
+		double w = it->second > 0 ? 1.0 / (it->second * it->second) : 1.0;
+		sw += w; sx += w * it->first; sy += w * it->second;
+		sxx += w * it->first * it->first; sxy += w * it->first * it->second;
+	}
+	double den = sw * sxx - sx * sx;
+	if (fit.points == 1 || den == 0) {
+		fit.alpha = sy / sw;
+	} else {
+		fit.beta = (sw * sxy - sx * sy) / den;
+		fit.alpha = (sy - fit.beta * sx) / sw;
+	}
+
+	double mean = 0;
+	for (Points::const_iterator it = begin; it != end; ++it) { mean += it->second; }
+	mean /= fit.points;
+
+	double ss_res = 0, ss_tot = 0;
+	for (Points::const_iterator it = begin; it != end; ++it) {
+		double err = it->second - fit.predict(it->first);
+		ss_res += err * err;
+		ss_tot += (it->second - mean) * (it->second - mean);
+		if (it->second > 0) { fit.mre += fabs(err) / it->second; }
+	}
+	fit.r2 = ss_tot > 0 ? 1 - ss_res / ss_tot : 1;
+	fit.mre /= fit.points;
+	return fit;
+}
+
+static double sse(const LinearFit& fit, Points::const_iterator begin, Points::const_iterator end) {
+	double ret = 0;
+	for (Points::const_iterator it = begin; it != end; ++it) {
+		if (it->second <= 0) { continue; }
+		double err = (it->second - fit.predict(it->first)) / it->second;
+		ret += err * err;
+	}
+	return ret;
+}
+
+/**
+ * Splits the points after each of the breakpoints (a point equal to a breakpoint belongs to
+ * the lower segment), segments need at least 2 points otherwise they are merged with the
+ * previous one. Without breakpoints the single split with the smallest error is used.
+ */
+static std::vector<LinearFit> piecewise(const Points& points, const std::vector<size_t>& breakpoints) {
+	std::vector<LinearFit> ret;
+	if (points.size() < 4) {
+		ret.push_back( hockney(points.begin(), points.end()) );
+		return ret;
+	}
+
+	std::vector<size_t> cuts; // index of the first point of each segment
+	cuts.push_back(0);
+	if (breakpoints.empty()) {
+		double best = sse(hockney(points.begin(), points.end()), points.begin(), points.end());
+		size_t best_cut = 0;
+		for (size_t cut=2; cut+2<=points.size(); ++cut) {
+			Points::const_iterator mid = points.begin()+cut;
+			double err = sse(hockney(points.begin(), mid), points.begin(), mid) +
+						 sse(hockney(mid, points.end()), mid, points.end());
+			if (err < best) { best = err; best_cut = cut; }
+		}
+		if (best_cut) { cuts.push_back(best_cut); }
+	} else {
+		for (size_t idx=0; idx<breakpoints.size(); ++idx) {
+			size_t cut = 0;
+			while (cut < points.size() && points[cut].first <= breakpoints[idx]) { ++cut; }
+			if (cut - cuts.back() >= 2 && points.size() - cut >= 2) { cuts.push_back(cut); }
+		}
+	}
+	cuts.push_back(points.size());
+
+	for (size_t idx=0; idx+1<cuts.size(); ++idx) {
+		ret.push_back( hockney(points.begin()+cuts[idx], points.begin()+cuts[idx+1]) );
+	}
+	return ret;
+}
+
+static Points medians(const ResultSet& results, RegionID base) {
+	Points ret;
+	std::map<RegionKey, std::vector<double> >::const_iterator it = results.times.lower_bound(RegionKey(base, 0));
+	for (; it != results.times.end() && it->first.base == base; ++it) {
+		if (!it->second.empty()) {
+			ret.push_back( std::make_pair(it->first.size, median_of(it->second.begin(), it->second.end())) );
+		}
+	}
+	return ret;
+}
+
+/**
+ * Thresholds of the protocol detection (cache_bench.protocol.csv), the last size below
+ * each switch is used as breakpoint
+ */
+static std::vector<size_t> load_protocol(const std::string& file_name) {
+	std::ifstream file(file_name.c_str());
+	if (!file) { throw std::logic_error("Cannot open protocol file: " + file_name); }
+
+	std::vector<size_t> ret;
+	std::string line, state;
+	std::getline(file, line); // header
+	while (std::getline(file, line)) {
+		std::istringstream row(line);
+		size_t below;
+		if (row >> state >> below) { ret.push_back(below); }
+	}
+	return ret;
+}
+
+static void print_fit(std::ostream& out, const LinearFit& fit) {
+	out << "{ \"from\": " << fit.from << ", \"to\": " << fit.to << ", \"points\": " << fit.points
+		<< ", \"alpha\": " << fit.alpha << ", \"beta\": " << fit.beta
+		<< ", \"r2\": " << fit.r2 << ", \"mre\": " << fit.mre << " }";
+}
+
+int main(int argc, char* argv[]) {
+
+	std::string json_file, protocol_file;
+	std::vector<size_t> cache_sizes;
+	unsigned window = 64;
+	std::vector<std::string> files;
+
+	for (int idx=1; idx<argc; ++idx) {
+		std::string arg = argv[idx];
+		if (arg == "--json" && idx+1 < argc) { json_file = argv[++idx]; }
+		else if (arg == "--protocol" && idx+1 < argc) { protocol_file = argv[++idx]; }
+		else if (arg == "--window" && idx+1 < argc) { window = strtoul(argv[++idx], NULL, 10); }
+		else if (arg == "--cache" && idx+1 < argc) {
+			std::istringstream ss(argv[++idx]);
+			std::string tok;
+			while (std::getline(ss, tok, ',')) {
+				if (parse_size(tok)) { cache_sizes.push_back(parse_size(tok)); }
+			}
+		}
+		else if (arg.compare(0, 2, "--") == 0) { files.clear(); break; }
+		else { files.push_back(arg); }
+	}
+
+	if (files.empty() || files.size() > 2 || window == 0) {
+		std::cerr << "Usage: " << argv[0] << " [--json FILE] [--protocol FILE] [--cache SIZES] [--window N] "
+				  << "cache_bench.r0.csv [cache_bench.r1.csv]" << std::endl;
+		return 1;
+	}
+
+	std::vector<ResultSet> results;
+	std::vector<size_t> breakpoints;
+	try {
+		for (size_t idx=0; idx<files.size(); ++idx) { results.push_back( load_results(files[idx]) ); }
+		if (!protocol_file.empty()) { breakpoints = load_protocol(protocol_file); }
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	breakpoints.insert(breakpoints.end(), cache_sizes.begin(), cache_sizes.end());
+	std::sort(breakpoints.begin(), breakpoints.end());
+	breakpoints.erase(std::unique(breakpoints.begin(), breakpoints.end()), breakpoints.end());
+
+	std::ostringstream json;
+	json << "{\n  \"unit\": \"cycles\",\n  \"breakpoints\": [";
+	for (size_t idx=0; idx<breakpoints.size(); ++idx) { json << (idx ? ", " : "") << breakpoints[idx]; }
+	json << "],\n  \"models\": [";
+
+	std::cout << std::setw(6) << "rank" << std::setw(28) << "test" << std::setw(12) << "from"
+			  << std::setw(12) << "to" << std::setw(15) << "alpha" << std::setw(15) << "beta"
+			  << std::setw(12) << "r2" << std::setw(12) << "mre" << std::endl;
+
+	bool first = true;
+	for (size_t rank=0; rank<results.size(); ++rank) {
+		std::vector<RegionID> bases;
+		for (std::map<RegionKey, std::vector<double> >::const_iterator it = results[rank].times.begin();
+				it != results[rank].times.end(); ++it) {
+			if (bases.empty() || bases.back() != it->first.base) { bases.push_back(it->first.base); }
+		}
+
+		for (size_t idx=0; idx<bases.size(); ++idx) {
+			const Points& points = medians(results[rank], bases[idx]);
+			if (points.empty()) { continue; }
+
+			const LinearFit& fit = hockney(points.begin(), points.end());
+			const std::vector<LinearFit>& pieces = piecewise(points, breakpoints);
+			const std::string& name = region_name(bases[idx]);
+
+			std::cout << std::setw(6) << rank << std::setw(28) << name << std::setw(12) << fit.from
+					  << std::setw(12) << fit.to << std::setw(15) << fit.alpha << std::setw(15) << fit.beta
+					  << std::setw(12) << fit.r2 << std::setw(12) << fit.mre << std::endl;
+			for (size_t p=0; p<pieces.size() && pieces.size()>1; ++p) {
+				std::cout << std::setw(6) << "" << std::setw(28) << "  piece" << std::setw(12) << pieces[p].from
+						  << std::setw(12) << pieces[p].to << std::setw(15) << pieces[p].alpha
+						  << std::setw(15) << pieces[p].beta << std::setw(12) << pieces[p].r2
+						  << std::setw(12) << pieces[p].mre << std::endl;
+			}
+
+			json << (first ? "\n" : ",\n") << "    { \"rank\": " << rank << ", \"id\": " << bases[idx]
+				 << ", \"name\": \"" << name << "\",\n      \"hockney\": ";
+			print_fit(json, fit);
+			json << ",\n      \"piecewise\": [";
+			for (size_t p=0; p<pieces.size(); ++p) {
+				json << (p ? ",\n        " : "\n        ");
+				print_fit(json, pieces[p]);
+			}
+			json << " ] }";
+			first = false;
+		}
+	}
+	json << "\n  ],\n  \"loggp\": [";
+
+	// LogGP of the send/recv tests: the overhead o is the time of the sender for the smallest
+	// message, the receiver completes after o + L + (n-1)G + o. The gap g is the time per message
+	// of the streaming test with the same cache state.
+	first = true;
+	if (results.size() == 2) {
+		std::cout << std::endl << std::setw(28) << "loggp" << std::setw(15) << "L" << std::setw(15) << "o"
+				  << std::setw(15) << "g" << std::setw(15) << "G" << std::endl;
+
+		for (unsigned st=0; st<3; ++st) {
+			RegionID comm = 305200 + st*1000, stream = 550200 + st*1000;
+
+			const Points& snd = medians(results[0], comm);
+			const Points& rcv = medians(results[1], comm);
+			if (snd.empty() || rcv.size() < 2) { continue; }
+
+			const LinearFit& fit = hockney(rcv.begin(), rcv.end());
+			LogGP m;
+			m.o = snd.front().second;
+			m.G = fit.beta;
+			m.L = std::max(0.0, fit.alpha - 2*m.o);
+			const Points& str = medians(results[1], stream);
+			m.g = str.empty() ? std::numeric_limits<double>::quiet_NaN() : str.front().second / window;
+
+			std::cout << std::setw(28) << region_name(comm) << std::setw(15) << m.L << std::setw(15) << m.o
+					  << std::setw(15) << m.g << std::setw(15) << m.G << std::endl;
+
+			json << (first ? "\n" : ",\n") << "    { \"name\": \"" << region_name(comm) << "\", \"L\": " << m.L
+				 << ", \"o\": " << m.o << ", \"g\": ";
+			if (str.empty()) { json << "null"; } else { json << m.g; }
+			json << ", \"G\": " << m.G << " }";
+			first = false;
+		}
+	}
+	json << "\n  ]\n}\n";
+
+	if (!json_file.empty()) {
+		std::ofstream out(json_file.c_str());
+		out << json.str();
+		if (!out) {
+			std::cerr << "Cannot write " << json_file << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,449 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * PMPI interposition library (libcacheprof.so) which profiles the cache behaviour of the
+ * MPI calls of real applications:
+ *
+ * 		LD_PRELOAD=./libcacheprof.so mpirun -np N ./app
+ *
+ * The counters listed in CACHEPROF_EVENTS are started in MPI_Init and never stopped, every
+ * wrapped call samples them before and after invoking its PMPI counterpart. Deltas are
+ * accumulated into a preallocated table keyed by operation, call site and message size
+ * bucket (power of two), so the wrappers do not allocate memory. The table of each rank is
+ * written into cacheprof.rN.csv by MPI_Finalize.
+ *
+ * Only the C bindings are wrapped and the counters are read by the thread calling MPI,
+ * which fits MPI_THREAD_SINGLE and MPI_THREAD_FUNNELED applications.
+ */
+
+#include "papi_wrap.h"
+#include "options.h"
+#include "symbols.h"
+
+#include <mpi.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+	const size_t MAX_ENTRIES = 4096;
+	const size_t MAX_EVENTS = 8;
+	const size_t MAX_REQUESTS = 1024;
+
+	struct Entry {
+		const char* 		op;
+		void*				site;
+		unsigned 			bucket;
+		unsigned long long 	calls;
+		CounterValue 		cycles;
+		CounterValue 		values[MAX_EVENTS];
+	};
+
+	// Bytes transferred by a pending non-blocking operation, used to bucket the completion calls
+	struct Pending {
+		MPI_Request req;
+		long long 	bytes;
+		bool 		used;
+	};
+
+	Entry 		entries[MAX_ENTRIES];
+	Pending 	pending[MAX_REQUESTS];
+
+	PapiWrap* 	papi = NULL;
+	EventNames 	event_names;
+	size_t 		num_events = 0;
+	bool 		in_region = false;
+
+	inline unsigned bucket_of(long long bytes) {
+		unsigned bucket = 0;
+		while (bytes > 0) { bytes >>= 1; ++bucket; }
+		return bucket;
+	}
+
+	inline long long bytes_of(int count, MPI_Datatype type) {
+		int type_size = 0;
+		PMPI_Type_size(type, &type_size);
+		return static_cast<long long>(count) * type_size;
+	}
+
+	inline size_t hash(const void* data, size_t len) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		size_t h = 14695981039346656037ULL;
+		for (size_t i=0; i<len; ++i) { h = (h ^ bytes[i]) * 1099511628211ULL; }
+		return h;
+	}
+
+	/**
+	 * Finds the entry of (op, site, bucket) with open addressing, when the table is full the
+	 * last slot collects all the remaining calls
+	 */
+	inline Entry& lookup(const char* op, void* site, unsigned bucket) {
+		size_t key[3] = { reinterpret_cast<size_t>(op), reinterpret_cast<size_t>(site), bucket };
+		size_t idx = hash(key, sizeof(key)) % (MAX_ENTRIES-1);
+		for (size_t probe=0; probe<MAX_ENTRIES-1; ++probe) {
+			Entry& e = entries[idx];
+			if (e.calls == 0) {
+				e.op = op; e.site = site; e.bucket = bucket;
+				return e;
+			}
+			if (e.op == op && e.site == site && e.bucket == bucket) { return e; }
+			idx = (idx+1) % (MAX_ENTRIES-1);
+		}
+		Entry& e = entries[MAX_ENTRIES-1];
+		e.op = "OTHER"; e.site = NULL; e.bucket = 0;
+		return e;
+	}
+
+	/**
+	 * Slot of a pending request, -1 if it is not tracked. The handle is looked up before the
+	 * completion call, which resets it to MPI_REQUEST_NULL
+	 */
+	inline int find_request(const MPI_Request& req) {
+		if (req == MPI_REQUEST_NULL) { return -1; }
+		size_t idx = hash(&req, sizeof(MPI_Request)) % MAX_REQUESTS;
+		for (size_t probe=0; probe<MAX_REQUESTS; ++probe) {
+			Pending& p = pending[(idx+probe) % MAX_REQUESTS];
+			if (p.used && memcmp(&p.req, &req, sizeof(MPI_Request)) == 0) { return (idx+probe) % MAX_REQUESTS; }
+		}
+		return -1;
+	}
+
+	inline long long bytes_of_slot(int slot) { return slot < 0 ? 0 : pending[slot].bytes; }
+
+	inline void release_request(int slot) {
+		if (slot >= 0) { pending[slot].used = false; }
+	}
+
+	inline void track_request(const MPI_Request& req, long long bytes) {
+		// MPI reuses the handles, an entry left behind by an untracked completion is replaced
+		int slot = find_request(req);
+		if (slot >= 0) {
+			pending[slot].bytes = bytes;
+			return;
+		}
+		size_t idx = hash(&req, sizeof(MPI_Request)) % MAX_REQUESTS;
+		for (size_t probe=0; probe<MAX_REQUESTS; ++probe) {
+			Pending& p = pending[(idx+probe) % MAX_REQUESTS];
+			if (!p.used) {
+				p.req = req; p.bytes = bytes; p.used = true;
+				return;
+			}
+		}
+		// table full, the completion is accounted in the 0 bytes bucket
+	}
+
+	/**
+	 * Slots of an array of requests (only the first MAX_REQUESTS can be tracked), returns
+	 * the bytes of all of them
+	 */
+	inline long long find_requests(int count, const MPI_Request* reqs, int* slots) {
+		long long bytes = 0;
+		for (int i=0; i<count && i<static_cast<int>(MAX_REQUESTS); ++i) {
+			slots[i] = find_request(reqs[i]);
+			bytes += bytes_of_slot(slots[i]);
+		}
+		return bytes;
+	}
+
+	inline int slot_at(int count, const int* slots, int i) { 
+		return i >= 0 && i < count && i < static_cast<int>(MAX_REQUESTS) ? slots[i] : -1; 
+	}
+
+	/**
+	 * Counter region around a PMPI call, the values are sampled on construction and the
+	 * deltas are accumulated on destruction. Nested MPI calls (i.e. made by the MPI library
+	 * itself) are accounted to the outer call
+	 */
+	class Region {
+		const char* 	op;
+		void* 			site;
+		long long 		bytes;
+		bool 			active;
+		CounterValue 	start_time;
+		CounterValue 	start[MAX_EVENTS];
+
+	public:
+		Region(const char* op, void* site, long long bytes) :
+			op(op), site(site), bytes(bytes), active(papi && !in_region)
+		{
+			if (!active) { return; }
+			in_region = true;
+			try {
+				start_time = papi->sample(start);
+			} catch(const std::logic_error& e) { 
+				in_region = active = false; 
+			}
+		}
+
+		// the bytes of MPI_Waitany/Waitsome/Test* are known after the call
+		void set_bytes(long long b) { bytes = b; }
+
+		~Region() {
+			if (!active) { return; }
+
+			in_region = false;
+
+			CounterValue end[MAX_EVENTS];
+			CounterValue end_time;
+			try {
+				end_time = papi->sample(end);
+			} catch(const std::logic_error& e) { return; }
+
+			Entry& e = lookup(op, site, bucket_of(bytes));
+			++e.calls;
+			e.cycles += end_time-start_time;
+			for (size_t i=0; i<num_events; ++i) { e.values[i] += end[i]-start[i]; }
+		}
+	};
+
+	void start_profiling() {
+		std::istringstream ss(env_string("CACHEPROF_EVENTS", "PAPI_L2_TCM,PAPI_L3_TCM"));
+		std::string tok;
+		while(std::getline(ss, tok, ',')) {
+			if (!tok.empty()) { event_names.push_back(tok); }
+		}
+
+		try {
+			papi = new PapiWrap();
+			event_names.resize(std::min(event_names.size(), std::min(MAX_EVENTS, papi->num_counters())));
+			papi->set_events(event_names);
+			papi->start();
+			num_events = papi->num_events();
+		} catch(const std::logic_error& e) {
+			std::cerr << "[cacheprof] Profiling disabled: " << e.what() << std::endl;
+			delete papi;
+			papi = NULL;
+		}
+	}
+
+	void stop_profiling() {
+		if (!papi) { return; }
+
+		int rank;
+		PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+		std::ostringstream fileName;
+		fileName << "cacheprof.r" << rank << ".csv";
+		std::fstream out(fileName.str().c_str(), std::fstream::out | std::fstream::trunc);
+
+		out << std::setw(16) << "op" << std::setw(20) << "site" << std::setw(40) << "symbol"
+			<< std::setw(12) << "bytes" << std::setw(12) << "calls" << std::setw(18) << "cycles";
+		for (size_t i=0; i<num_events; ++i) { out << std::setw(18) << event_names[i]; }
+		out << std::endl;
+
+		for (size_t idx=0; idx<MAX_ENTRIES; ++idx) {
+			const Entry& e = entries[idx];
+			if (e.calls == 0) { continue; }
+
+			const std::string& symbol = symbol_name(e.site);
+
+			out << std::setw(16) << e.op
+				<< std::setw(20) << e.site
+				<< std::setw(40) << symbol
+				// lower bound of the size bucket
+				<< std::setw(12) << (e.bucket ? 1ULL << (e.bucket-1) : 0)
+				<< std::setw(12) << e.calls
+				<< std::setw(18) << e.cycles;
+			for (size_t i=0; i<num_events; ++i) { out << std::setw(18) << e.values[i]; }
+			out << std::endl;
+		}
+
+		delete papi;
+		papi = NULL;
+	}
+
+} // end anonymous namespace
+
+#define PROFILE(op, bytes) Region region(op, __builtin_return_address(0), bytes)
+
+extern "C" {
+
+int MPI_Init(int* argc, char*** argv) {
+	int ret = PMPI_Init(argc, argv);
+	start_profiling();
+	return ret;
+}
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+	int ret = PMPI_Init_thread(argc, argv, required, provided);
+	start_profiling();
+	return ret;
+}
+
+int MPI_Finalize() {
+	stop_profiling();
+	return PMPI_Finalize();
+}
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+	PROFILE("MPI_Send", bytes_of(count, type));
+	return PMPI_Send(buf, count, type, dest, tag, comm);
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status* status) {
+	PROFILE("MPI_Recv", bytes_of(count, type));
+	return PMPI_Recv(buf, count, type, source, tag, comm, status);
+}
+
+int MPI_Sendrecv(const void* sbuf, int scount, MPI_Datatype stype, int dest, int stag,
+				 void* rbuf, int rcount, MPI_Datatype rtype, int source, int rtag, MPI_Comm comm, MPI_Status* status) {
+	PROFILE("MPI_Sendrecv", bytes_of(scount, stype) + bytes_of(rcount, rtype));
+	return PMPI_Sendrecv(sbuf, scount, stype, dest, stag, rbuf, rcount, rtype, source, rtag, comm, status);
+}
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* req) {
+	long long bytes = bytes_of(count, type);
+	PROFILE("MPI_Isend", bytes);
+	int ret = PMPI_Isend(buf, count, type, dest, tag, comm, req);
+	if (ret == MPI_SUCCESS) { track_request(*req, bytes); }
+	return ret;
+}
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request* req) {
+	long long bytes = bytes_of(count, type);
+	PROFILE("MPI_Irecv", bytes);
+	int ret = PMPI_Irecv(buf, count, type, source, tag, comm, req);
+	if (ret == MPI_SUCCESS) { track_request(*req, bytes); }
+	return ret;
+}
+
+int MPI_Wait(MPI_Request* req, MPI_Status* status) {
+	int slot = find_request(*req);
+	PROFILE("MPI_Wait", bytes_of_slot(slot));
+	int ret = PMPI_Wait(req, status);
+	release_request(slot);
+	return ret;
+}
+
+int MPI_Waitall(int count, MPI_Request* reqs, MPI_Status* statuses) {
+	int slots[MAX_REQUESTS];
+	PROFILE("MPI_Waitall", find_requests(count, reqs, slots));
+	int ret = PMPI_Waitall(count, reqs, statuses);
+	for (int i=0; i<count; ++i) { release_request(slot_at(count, slots, i)); }
+	return ret;
+}
+
+int MPI_Waitany(int count, MPI_Request* reqs, int* index, MPI_Status* status) {
+	int slots[MAX_REQUESTS];
+	find_requests(count, reqs, slots);
+	PROFILE("MPI_Waitany", 0);
+	int ret = PMPI_Waitany(count, reqs, index, status);
+	if (*index != MPI_UNDEFINED) {
+		int slot = slot_at(count, slots, *index);
+		region.set_bytes(bytes_of_slot(slot));
+		release_request(slot);
+	}
+	return ret;
+}
+
+int MPI_Waitsome(int incount, MPI_Request* reqs, int* outcount, int* indices, MPI_Status* statuses) {
+	int slots[MAX_REQUESTS];
+	find_requests(incount, reqs, slots);
+	PROFILE("MPI_Waitsome", 0);
+	int ret = PMPI_Waitsome(incount, reqs, outcount, indices, statuses);
+	long long bytes = 0;
+	for (int i=0; *outcount != MPI_UNDEFINED && i<*outcount; ++i) {
+		int slot = slot_at(incount, slots, indices[i]);
+		bytes += bytes_of_slot(slot);
+		release_request(slot);
+	}
+	region.set_bytes(bytes);
+	return ret;
+}
+
+int MPI_Test(MPI_Request* req, int* flag, MPI_Status* status) {
+	int slot = find_request(*req);
+	PROFILE("MPI_Test", bytes_of_slot(slot));
+	int ret = PMPI_Test(req, flag, status);
+	if (*flag) { release_request(slot); }
+	return ret;
+}
+
+int MPI_Testall(int count, MPI_Request* reqs, int* flag, MPI_Status* statuses) {
+	int slots[MAX_REQUESTS];
+	PROFILE("MPI_Testall", find_requests(count, reqs, slots));
+	int ret = PMPI_Testall(count, reqs, flag, statuses);
+	for (int i=0; *flag && i<count; ++i) { release_request(slot_at(count, slots, i)); }
+	return ret;
+}
+
+int MPI_Testany(int count, MPI_Request* reqs, int* index, int* flag, MPI_Status* status) {
+	int slots[MAX_REQUESTS];
+	find_requests(count, reqs, slots);
+	PROFILE("MPI_Testany", 0);
+	int ret = PMPI_Testany(count, reqs, index, flag, status);
+	if (*flag && *index != MPI_UNDEFINED) {
+		int slot = slot_at(count, slots, *index);
+		region.set_bytes(bytes_of_slot(slot));
+		release_request(slot);
+	}
+	return ret;
+}
+
+int MPI_Testsome(int incount, MPI_Request* reqs, int* outcount, int* indices, MPI_Status* statuses) {
+	int slots[MAX_REQUESTS];
+	find_requests(incount, reqs, slots);
+	PROFILE("MPI_Testsome", 0);
+	int ret = PMPI_Testsome(incount, reqs, outcount, indices, statuses);
+	long long bytes = 0;
+	for (int i=0; *outcount != MPI_UNDEFINED && i<*outcount; ++i) {
+		int slot = slot_at(incount, slots, indices[i]);
+		bytes += bytes_of_slot(slot);
+		release_request(slot);
+	}
+	region.set_bytes(bytes);
+	return ret;
+}
+
+int MPI_Request_free(MPI_Request* req) {
+	release_request(find_request(*req));
+	return PMPI_Request_free(req);
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+	PROFILE("MPI_Barrier", 0);
+	return PMPI_Barrier(comm);
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+	PROFILE("MPI_Bcast", bytes_of(count, type));
+	return PMPI_Bcast(buf, count, type, root, comm);
+}
+
+int MPI_Reduce(const void* sbuf, void* rbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+	PROFILE("MPI_Reduce", bytes_of(count, type));
+	return PMPI_Reduce(sbuf, rbuf, count, type, op, root, comm);
+}
+
+int MPI_Allreduce(const void* sbuf, void* rbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+	PROFILE("MPI_Allreduce", bytes_of(count, type));
+	return PMPI_Allreduce(sbuf, rbuf, count, type, op, comm);
+}
+
+int MPI_Allgather(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount, MPI_Datatype rtype, MPI_Comm comm) {
+	PROFILE("MPI_Allgather", bytes_of(scount, stype));
+	return PMPI_Allgather(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+}
+
+int MPI_Alltoall(const void* sbuf, int scount, MPI_Datatype stype, void* rbuf, int rcount, MPI_Datatype rtype, MPI_Comm comm) {
+	PROFILE("MPI_Alltoall", bytes_of(scount, stype));
+	return PMPI_Alltoall(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+}
+
+} // end extern "C"
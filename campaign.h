@@ -0,0 +1,217 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Campaign of the sweep: the space test x size x event group is split into work items which
+ * are measured independently (possibly by different pairs of processes) and checkpointed,
+ * an interrupted campaign resumes from the items which were not completed. The results of
+ * each item are written into their own files which are merged into the usual result files
+ * (cache_bench.r0.csv, cache_bench.r1.csv) once every item is done.
+ */
+
+#include "results.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+struct CampaignShape {
+	unsigned tests;
+	unsigned sizes;
+	unsigned groups;
+	unsigned repetitions;
+	// optional columns of the result files (i.e. "verify,noise"), "none" if none
+	std::string 				columns;
+	std::vector<std::string> 	events;
+
+	CampaignShape(unsigned tests, unsigned sizes, unsigned groups, unsigned repetitions, 
+				  const std::string& columns, const std::vector<std::string>& events) : 
+		tests(tests), sizes(sizes), groups(groups), repetitions(repetitions), columns(columns), events(events) { }
+
+	unsigned items() const { return tests * sizes * groups; }
+
+	// items of the same size and test are contiguous, in the order of the sweep
+	unsigned item(unsigned test, unsigned size, unsigned group) const { return (size*tests + test)*groups + group; }
+
+	unsigned group_of(unsigned item) const { return item % groups; }
+	unsigned test_of(unsigned item) const { return item / groups % tests; }
+	unsigned size_of(unsigned item) const { return item / groups / tests; }
+
+	/**
+	 * Everything which makes the results of two runs of the campaign comparable, on a single line
+	 */
+	std::string signature() const {
+		std::ostringstream ss;
+		ss << "tests " << tests << " sizes " << sizes << " groups " << groups << " repetitions " << repetitions 
+		   << " columns " << columns << " events";
+		for (size_t idx=0; idx<events.size(); ++idx) { ss << " " << events[idx]; }
+		return ss.str();
+	}
+
+	static CampaignShape from_signature(const std::string& sig) {
+		std::istringstream ss(sig);
+		std::string tags[6];
+		CampaignShape ret(0, 0, 0, 0, "", std::vector<std::string>());
+		ss >> tags[0] >> ret.tests >> tags[1] >> ret.sizes >> tags[2] >> ret.groups >> tags[3] >> ret.repetitions 
+		   >> tags[4] >> ret.columns >> tags[5];
+		if (!ss || tags[0] != "tests" || tags[1] != "sizes" || tags[2] != "groups" || tags[3] != "repetitions" ||
+			tags[4] != "columns" || tags[5] != "events") {
+			throw std::logic_error("Malformed campaign signature: " + sig);
+		}
+		for (std::string evt; ss >> evt; ) { ret.events.push_back(evt); }
+		return ret;
+	}
+};
+
+/**
+ * Progress of a campaign, kept in <dir>/progress: the shape of the campaign followed by one
+ * line per completed item. A line is only trusted if it was completely written
+ */
+class CampaignCheckpoint {
+
+	std::string 		dir;
+	std::ofstream 		progress;
+	std::vector<bool> 	done;
+	size_t 				num_done;
+
+public:
+
+	/**
+	 * Creates the campaign directory or loads the items completed by a previous run of the
+	 * same campaign (a campaign with a different shape is an error)
+	 */
+	CampaignCheckpoint(const std::string& dir, const CampaignShape& shape) : dir(dir), done(shape.items()), num_done(0) {
+		if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+			throw std::logic_error("Cannot create campaign directory: " + dir);
+		}
+
+		const std::string& file_name = dir + "/progress";
+		std::ifstream in(file_name.c_str());
+		std::string line;
+		if (std::getline(in, line)) {
+			if (line != shape.signature()) {
+				throw std::logic_error("Campaign in " + dir + " has a different shape: " + line);
+			}
+			while (std::getline(in, line)) {
+				std::istringstream ss(line);
+				std::string tag, end;
+				unsigned item;
+				if (ss >> tag >> item >> end && tag == "item" && end == "done" && item < done.size() && !done[item]) {
+					done[item] = true;
+					++num_done;
+				}
+			}
+			in.close();
+			progress.open(file_name.c_str(), std::ios::out | std::ios::app);
+		} else {
+			progress.open(file_name.c_str(), std::ios::out | std::ios::trunc);
+			progress << shape.signature() << std::endl;
+		}
+		if (!progress) { throw std::logic_error("Cannot write campaign progress: " + file_name); }
+	}
+
+	bool is_done(unsigned item) const { return done[item]; }
+	size_t get_num_done() const { return num_done; }
+	const std::string& get_dir() const { return dir; }
+
+	void mark_done(unsigned item) {
+		if (item >= done.size() || done[item]) { return; }
+		done[item] = true;
+		++num_done;
+		progress << "item " << item << " done" << std::endl;
+	}
+
+	static std::string item_file(const std::string& dir, unsigned item, int rank) {
+		std::ostringstream ss;
+		ss << dir << "/item" << item << ".r" << rank << ".csv";
+		return ss.str();
+	}
+};
+
+/**
+ * Merges the files of the items of one rank into a single result file. The rows of the event
+ * groups of a test are joined by their order (as the passes of a region are joined by the
+ * measurement), the first group gives the time and the other columns; a row is valid only if
+ * it is valid in every group. The items of a group must all have the same header
+ */
+inline void merge_campaign(const std::string& dir, const CampaignShape& shape, int rank, const std::string& out_name) {
+	std::ofstream out(out_name.c_str(), std::ios::out | std::ios::trunc);
+	bool header_written = false;
+	std::vector<std::vector<std::string> > group_names(shape.groups);
+
+	for (unsigned size=0; size<shape.sizes; ++size) {
+		for (unsigned test=0; test<shape.tests; ++test) {
+			std::vector<std::string> header;
+			std::vector<std::vector<std::string> > rows;
+
+			for (unsigned group=0; group<shape.groups; ++group) {
+				const std::string& file_name = CampaignCheckpoint::item_file(dir, shape.item(test, size, group), rank);
+				std::ifstream in(file_name.c_str());
+				std::string line, tok;
+				if (!std::getline(in, line)) { throw std::logic_error("Missing campaign result: " + file_name); }
+
+				std::vector<std::string> names;
+				for (std::istringstream ss(line); ss >> tok; ) { names.push_back(tok); }
+				if (group_names[group].empty()) { 
+					group_names[group] = names; 
+				} else if (names != group_names[group]) {
+					throw std::logic_error("Campaign result with a different header: " + file_name);
+				}
+				size_t first = group == 0 ? 0 : first_counter_column(names);
+				header.insert(header.end(), names.begin()+std::min(first, names.size()), names.end());
+				size_t valid = std::find(names.begin(), names.end(), "valid") - names.begin();
+
+				size_t row = 0;
+				for (; std::getline(in, line); ++row) {
+					std::vector<std::string> vals;
+					for (std::istringstream ss(line); ss >> tok; ) { vals.push_back(tok); }
+					if (group == 0) {
+						rows.push_back(vals);
+					} else if (row < rows.size()) {
+						if (valid < vals.size() && valid < rows[row].size() && vals[valid] == "0") { rows[row][valid] = "0"; }
+						rows[row].insert(rows[row].end(), vals.begin()+std::min(first, vals.size()), vals.end());
+					}
+				}
+				if (row != rows.size()) {
+					std::cerr << "WARNING: " << file_name << " has " << row << " rows instead of " << rows.size() << std::endl;
+					rows.resize(std::min(row, rows.size()));
+				}
+			}
+
+			if (!header_written) {
+				for (size_t idx=0; idx<header.size(); ++idx) { out << std::setw(header[idx].size()+2) << header[idx]; }
+				out << std::endl;
+				header_written = true;
+			}
+			for (size_t r=0; r<rows.size(); ++r) {
+				for (size_t idx=0; idx<rows[r].size(); ++idx) { out << std::setw(15) << rows[r][idx]; }
+				out << std::endl;
+			}
+		}
+	}
+}
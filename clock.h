@@ -0,0 +1,131 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Synchronization of the cycle counters of the 2 processes, rank 0 is the reference. Each
+ * round of a synchronization is a ping-pong: rank 0 sends at t0, rank 1 answers with its
+ * counter t1 and rank 0 receives at t2. Assuming symmetric delays, t1 was read at (t0+t2)/2
+ * on the reference clock. Only the rounds with the shortest round trip are kept and the
+ * offset of rank 1 is regressed over the reference time (offset + drift * t).
+ *
+ * The points of all the synchronizations are kept, repeating the synchronization during
+ * the run improves the estimate of the drift.
+ */
+
+#include <papi.h>
+#include <mpi.h>
+
+#include <vector>
+#include <algorithm>
+
+class ClockSync {
+
+	struct Round {
+		double rtt;
+		double mid;
+		double offset;
+
+		bool operator<(const Round& other) const { return rtt < other.rtt; }
+	};
+
+	// (reference time, offset) of the kept rounds
+	std::vector<std::pair<double,double> > points;
+
+	int 		rank;
+	unsigned 	rounds;
+	double 		offset;
+	double 		drift;
+
+	enum { MAX_POINTS = 4096 };
+
+	void fit() {
+		double mx = 0, my = 0;
+		for (size_t idx=0; idx<points.size(); ++idx) { mx += points[idx].first; my += points[idx].second; }
+		mx /= points.size();
+		my /= points.size();
+
+		// the reference times are large, the regression is computed around their mean
+		double sxx = 0, sxy = 0;
+		for (size_t idx=0; idx<points.size(); ++idx) {
+			double dx = points[idx].first - mx;
+			sxx += dx * dx;
+			sxy += dx * (points[idx].second - my);
+		}
+		drift = sxx > 0 ? sxy / sxx : 0;
+		offset = my - drift * mx;
+	}
+
+public:
+
+	ClockSync(int rank, unsigned rounds) : rank(rank), rounds(std::max(rounds, 4u)), offset(0), drift(0) { }
+
+	/**
+	 * Collective operation among the 2 processes, both of them get the updated model
+	 */
+	void sync(MPI_Comm comm) {
+		std::vector<Round> meas(rounds);
+		for (unsigned idx=0; idx<rounds; ++idx) {
+			long long t0, t1, t2;
+			if (rank == 0) {
+				t0 = PAPI_get_real_cyc();
+				PMPI_Send(NULL, 0, MPI_BYTE, 1, 0, comm);
+				PMPI_Recv(&t1, 1, MPI_LONG_LONG, 1, 0, comm, MPI_STATUS_IGNORE);
+				t2 = PAPI_get_real_cyc();
+				meas[idx].rtt = t2 - t0;
+				meas[idx].mid = t0 + (t2 - t0) / 2.0;
+				meas[idx].offset = t1 - meas[idx].mid;
+			} else {
+				PMPI_Recv(NULL, 0, MPI_BYTE, 0, 0, comm, MPI_STATUS_IGNORE);
+				t1 = PAPI_get_real_cyc();
+				PMPI_Send(&t1, 1, MPI_LONG_LONG, 0, 0, comm);
+			}
+		}
+
+		double model[2];
+		if (rank == 0) {
+			// the rounds with the shortest round trip have the smallest asymmetry
+			std::sort(meas.begin(), meas.end());
+			for (size_t idx=0; idx<std::max<size_t>(rounds/4, 1); ++idx) {
+				points.push_back( std::make_pair(meas[idx].mid, meas[idx].offset) );
+			}
+			if (points.size() > MAX_POINTS) { points.erase(points.begin(), points.end() - MAX_POINTS); }
+			fit();
+			model[0] = offset;
+			model[1] = drift;
+		}
+		MPI_Bcast(model, 2, MPI_DOUBLE, 0, comm);
+		offset = model[0];
+		drift = model[1];
+	}
+
+	/**
+	 * Offset of rank 1 at the given reference time (cycles)
+	 */
+	double get_offset(double ref_time = 0) const { return offset + drift * ref_time; }
+	double get_drift() const { return drift; }
+
+	/**
+	 * Converts a counter value of the given rank into the reference timebase
+	 */
+	double to_global(double local, int from_rank) const {
+		if (from_rank == 0) { return local; }
+		// local = ref + offset + drift * ref
+		return (local - offset) / (1 + drift);
+	}
+};
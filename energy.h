@@ -0,0 +1,160 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Energy measurement through the RAPL counters exposed by the Linux powercap framework
+ * (<root>/intel-rapl:N/energy_uj for the packages, the "dram" subdomains for the memory).
+ * The root is configurable so that a fake directory tree can be used for testing.
+ *
+ * The counters are updated about once per millisecond, much less often than a short region
+ * lasts: the energy of a single region is either 0 or a whole update. Summed over many
+ * repetitions the deltas are an unbiased estimate of the energy spent within the regions
+ * (the region starts are not correlated with the updates), reports use the sums.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+
+typedef long long EnergyValue; // micro joules
+
+struct EnergySample {
+	EnergyValue pkg;
+	EnergyValue dram;
+
+	EnergySample() : pkg(0), dram(0) { }
+};
+
+class EnergyMeter {
+
+	struct Domain {
+		int 			fd;
+		EnergyValue 	max_range;
+		bool 			dram;
+	};
+
+	std::vector<Domain> 	domains;
+	std::vector<EnergyValue> last; // reading of each domain at the last read()
+	bool 					enabled;
+
+	static std::string read_line(const std::string& file_name) {
+		std::ifstream file(file_name.c_str());
+		std::string line;
+		std::getline(file, line);
+		return line;
+	}
+
+	void add_domain(const std::string& dir, bool dram) {
+		Domain d;
+		d.fd = open((dir + "/energy_uj").c_str(), O_RDONLY);
+		if (d.fd < 0) { return; }
+		d.max_range = strtoll(read_line(dir + "/max_energy_range_uj").c_str(), NULL, 10);
+		d.dram = dram;
+		domains.push_back(d);
+	}
+
+	static std::vector<std::string> list(const std::string& dir, const std::string& prefix) {
+		std::vector<std::string> ret;
+		DIR* d = opendir(dir.c_str());
+		if (!d) { return ret; }
+		while (struct dirent* entry = readdir(d)) {
+			std::string name = entry->d_name;
+			if (name.compare(0, prefix.length(), prefix) == 0 &&
+				name.find(':', prefix.length()) == std::string::npos) {
+				ret.push_back(name);
+			}
+		}
+		closedir(d);
+		std::sort(ret.begin(), ret.end());
+		return ret;
+	}
+
+	// -1 if the counter could not be read
+	inline EnergyValue read_domain(size_t idx) const {
+		char buf[32];
+		ssize_t len = pread(domains[idx].fd, buf, sizeof(buf)-1, 0);
+		if (len <= 0 || buf[0] < '0' || buf[0] > '9') { return -1; }
+		buf[len] = '\0';
+		return strtoll(buf, NULL, 10);
+	}
+
+public:
+
+	EnergyMeter() : enabled(false) { }
+
+	/**
+	 * Opens every package domain under root and its dram subdomain. Returns false if no domain
+	 * could be opened
+	 */
+	bool enable(const std::string& root) {
+		const std::vector<std::string>& pkgs = list(root, "intel-rapl:");
+		for (size_t p=0; p<pkgs.size(); ++p) {
+			const std::string& dir = root + "/" + pkgs[p];
+			if (read_line(dir + "/name").compare(0, 7, "package") != 0) { continue; }
+			add_domain(dir, false);
+
+			const std::vector<std::string>& subs = list(dir, pkgs[p] + ":");
+			for (size_t s=0; s<subs.size(); ++s) {
+				if (read_line(dir + "/" + subs[s] + "/name") == "dram") { add_domain(dir + "/" + subs[s], true); }
+			}
+		}
+		last.resize(domains.size());
+		enabled = !domains.empty();
+		read();
+		return enabled;
+	}
+
+	bool is_enabled() const { return enabled; }
+	size_t num_domains() const { return domains.size(); }
+
+	/**
+	 * Energy consumed since the previous invocation, summed over the package and over the
+	 * dram domains (counter wrap-arounds are handled)
+	 */
+	inline EnergySample read() {
+		EnergySample ret;
+		for (size_t idx=0; idx<domains.size(); ++idx) {
+			EnergyValue curr = read_domain(idx);
+			if (curr < 0) { continue; }
+			EnergyValue delta = curr - last[idx];
+			if (delta < 0) { delta += domains[idx].max_range; }
+			last[idx] = curr;
+			(domains[idx].dram ? ret.dram : ret.pkg) += delta;
+		}
+		return ret;
+	}
+
+	void disable() {
+		for (size_t idx=0; idx<domains.size(); ++idx) { close(domains[idx].fd); }
+		domains.clear();
+		last.clear();
+		enabled = false;
+	}
+
+	~EnergyMeter() { disable(); }
+
+private:
+	EnergyMeter(const EnergyMeter& other); // make it not copyable
+};
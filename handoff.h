@@ -0,0 +1,157 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Local copy baselines for the MPI transfers: a non-temporal copy and a producer/consumer
+ * handoff through shared memory between the process and a helper thread pinned to another
+ * core. The handoff is the intra-node transfer without any MPI overhead: the consumer copies
+ * the producer's buffer, pulling its lines from the producer's cache.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#define SPIN_PAUSE _mm_pause()
+#else
+#define SPIN_PAUSE
+#endif
+
+/**
+ * Copy with non-temporal stores, the destination is not brought into the cache. Falls back
+ * to memcpy when the stores are not available or the buffers are not aligned
+ */
+inline void nt_copy(char* dst, const char* src, size_t size) {
+#ifdef __SSE2__
+	if ((reinterpret_cast<size_t>(dst) | reinterpret_cast<size_t>(src) | size) % sizeof(__m128i) == 0) {
+		__m128i* d = reinterpret_cast<__m128i*>(dst);
+		const __m128i* s = reinterpret_cast<const __m128i*>(src);
+		for (size_t i=0, end=size/sizeof(__m128i); i<end; ++i) {
+			_mm_stream_si128(d+i, _mm_load_si128(s+i));
+		}
+		_mm_sfence();
+		return;
+	}
+#endif
+	memcpy(dst, src, size);
+}
+
+class HandoffThread {
+
+	pthread_t 			thread;
+	unsigned 			core;
+
+	// the request is published by incrementing seq, the consumer acknowledges with done
+	volatile char* 		src;
+	volatile char* 		dst;
+	size_t 				size;
+	volatile unsigned 	seq;
+	volatile unsigned 	done;
+
+	// while armed the consumer spins waiting for work, otherwise it is blocked on wake
+	volatile bool 		armed;
+	volatile bool 		running;
+	pthread_mutex_t 	lock;
+	pthread_cond_t 		wake;
+
+	static void* run(void* arg) {
+		HandoffThread& self = *static_cast<HandoffThread*>(arg);
+
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		CPU_SET(self.core, &mask);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+
+		unsigned last = 0;
+		while (self.running) {
+			if (!self.armed) {
+				pthread_mutex_lock(&self.lock);
+				while (!self.armed && self.running) { pthread_cond_wait(&self.wake, &self.lock); }
+				pthread_mutex_unlock(&self.lock);
+				continue;
+			}
+			if (self.seq == last) { SPIN_PAUSE; continue; }
+
+			last = self.seq;
+			__sync_synchronize();
+			memcpy((char*)self.dst, (char*)self.src, self.size);
+			__sync_synchronize();
+			self.done = last;
+		}
+		return NULL;
+	}
+
+public:
+
+	HandoffThread(unsigned core) :
+		core(core), src(NULL), dst(NULL), size(0), seq(0), done(0), armed(false), running(true)
+	{
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&wake, NULL);
+		if (pthread_create(&thread, NULL, &HandoffThread::run, this) != 0) {
+			throw std::logic_error("Error while starting the handoff thread");
+		}
+	}
+
+	/**
+	 * The consumer starts spinning, to be invoked before setting up the cache state. Once
+	 * disarmed it blocks until the next arm(), it does not disturb the other tests
+	 */
+	void arm() { 
+		pthread_mutex_lock(&lock);
+		armed = true; 
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+	}
+	void disarm() { armed = false; }
+
+	/**
+	 * Hands src over to the consumer which copies it into dst, returns once the copy
+	 * is completed
+	 */
+	inline void handoff(volatile char* to, volatile char* from, size_t bytes) {
+		dst = to;
+		src = from;
+		size = bytes;
+		__sync_synchronize();
+		unsigned curr = ++seq;
+		while (done != curr) { SPIN_PAUSE; }
+		__sync_synchronize();
+	}
+
+	~HandoffThread() {
+		pthread_mutex_lock(&lock);
+		running = false;
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+		pthread_join(thread, NULL);
+		pthread_cond_destroy(&wake);
+		pthread_mutex_destroy(&lock);
+	}
+
+private:
+	HandoffThread(const HandoffThread& other); // make it not copyable
+};
@@ -0,0 +1,81 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Cache hints around the transfer of a message: software prefetch of the receive buffer,
+ * demotion of the lines of the send buffer to the shared cache (cldemote) and non-temporal
+ * stores to produce the message outside of the cache. All of them are hints, they fall back
+ * to plain code (or to nothing) when the instruction is not available.
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <cstring>
+
+// Strategy utilized around the transfer, the test ID is 2HA with H the strategy
+enum CacheHint { HINT_NONE=0, HINT_PREFETCH_POST=1, HINT_PREFETCH_DONE=2, HINT_CLDEMOTE=3, HINT_NT_SEND=4 };
+static const char* const hint_names[] = { "none", "pf_post", "pf_done", "cldemote", "nt_send" };
+#define NUM_HINTS 5
+
+/**
+ * Prefetches every line of the buffer (Write: with the intent to write it)
+ */
+template <int Write>
+inline void prefetch_lines(const volatile char* buf, size_t size, size_t cache_line) {
+	for (size_t idx=0; idx<size; idx+=cache_line) {
+		__builtin_prefetch(const_cast<const char*>(buf) + idx, Write, 3);
+	}
+}
+
+/**
+ * Moves the lines of the buffer from the private caches of the core to the shared cache,
+ * where the receiver can load them without snooping the sender's core. The instruction is
+ * a NOP on processors without cldemote, it is emitted as bytes so that no compiler support
+ * is needed
+ */
+inline void cldemote_lines(const volatile char* buf, size_t size, size_t cache_line) {
+#if defined(__x86_64__) || defined(__i386__)
+	for (size_t idx=0; idx<size; idx+=cache_line) {
+		// cldemote (%rax)
+		__asm__ __volatile__(".byte 0x0f, 0x1c, 0x00" : : "a"(buf + idx) : "memory");
+	}
+#endif
+}
+
+/**
+ * Fills the buffer with non-temporal stores, the lines are written to memory and evicted
+ * from the cache. Falls back to memset when the stores are not available or the buffer is
+ * not aligned
+ */
+inline void nt_fill(volatile char* buf, char value, size_t size) {
+#ifdef __SSE2__
+	if ((reinterpret_cast<size_t>(buf) | size) % sizeof(__m128i) == 0) {
+		__m128i* d = reinterpret_cast<__m128i*>(const_cast<char*>(buf));
+		const __m128i v = _mm_set1_epi8(value);
+		for (size_t i=0, end=size/sizeof(__m128i); i<end; ++i) {
+			_mm_stream_si128(d+i, v);
+		}
+		_mm_sfence();
+		return;
+	}
+#endif
+	memset(const_cast<char*>(buf), value, size);
+}
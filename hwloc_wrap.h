@@ -20,12 +20,17 @@
 /**
  * When the benchmark is compiled with HWLOC support then we use the library to detect 
  * information of the underlying CPU, like the amount of cache for each level of 
- * available caches and the number of sockets and cores available on the machine 
+ * available caches and the number of sockets and cores available on the machine. The line
+ * size of the first level data cache comes from hwloc or sysconf (CB_CACHE_LINE overrides it)
  */
 #ifdef USE_HWLOC
 #include <hwloc.h>
 #endif
 
+#include "options.h"
+
+#include <unistd.h>
+
 #include <cstring>
 
 void usage(char* argv[]) { 
@@ -44,8 +49,10 @@ struct Info {
 	unsigned levels;
 	// For each level contains the size of the cache at that level 
 	size_t* cache_sizes;
+	// Line size of the first level data cache, 64 if it cannot be detected
+	size_t cache_line;
 
-	Info(int argc, char* argv[]) : levels(0) {
+	Info(int argc, char* argv[]) : levels(0), cache_line(0) {
 
 #ifndef USE_HWLOC
 		if (argc != 4) { usage(argv); }
@@ -56,23 +63,16 @@ struct Info {
 		levels=1;
 		cache_sizes = new size_t[1];
 
-		char* size_str = argv[3];
-		unsigned multiplier = 1;
-
-		char* last = &size_str[strlen(size_str)-1];
-		if (!(*last >=0 && *last <= 9)) { 
-			switch (*last) {
-			case 'G': multiplier *= 1024;
-			case 'M': multiplier *= 1024;
-			case 'K': multiplier *= 1024;
-					  break;
-			default:
-				std::cerr << "Wrong quantifer, allowed quantifiers are: 'K' (1024), 'M' (1024K), 'G' (1024M)";
-				usage(argv);	
-			}
+		cache_sizes[0] = parse_size(argv[3]);
+		if (cache_sizes[0] == 0) {
+			std::cerr << "Wrong quantifer, allowed quantifiers are: 'K' (1024), 'M' (1024K), 'G' (1024M)";
+			usage(argv);
 		}
-		*last = '\0';
-		cache_sizes[0] = atoi(size_str) * multiplier;
+
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+		long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+		cache_line = line > 0 ? line : 0;
+#endif
 #endif
 
 #ifdef USE_HWLOC
@@ -95,6 +95,7 @@ struct Info {
 		if (obj->type == HWLOC_OBJ_CACHE) {
 			assert( levels < MAX_CACHE_LEVELS && "This architecture has more than 3 cache levels");
 			size[levels++] = obj->attr->cache.size;
+			if (!cache_line) { cache_line = obj->attr->cache.linesize; }
 		}
 
 		hwloc_topology_destroy(topology);
@@ -102,6 +103,8 @@ struct Info {
 		cache_sizes = new size_t[levels];
 		memcpy(cache_sizes, size, levels*sizeof(size_t));
 #endif 
+
+		cache_line = env_size("CB_CACHE_LINE", cache_line ? cache_line : 64);
 	}
 
 	~Info() {
@@ -0,0 +1,158 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Background interference generator. Antagonist threads are pinned to the given cores and
+ * put pressure on the memory hierarchy while the benchmark runs:
+ * 	- llc:  read-modify-write of a footprint (usually the size of the LLC) in a scattered
+ * 			order which defeats the prefetchers, lines of the benchmark get evicted
+ * 	- bw:   streaming over a large footprint to saturate the memory bandwidth
+ * 	- idle: threads are started but sleep, useful as control experiment
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+enum AntagonistMode { ANTAGONIST_IDLE, ANTAGONIST_LLC, ANTAGONIST_BW };
+
+inline AntagonistMode parse_antagonist_mode(const std::string& mode) {
+	if (mode == "idle") { return ANTAGONIST_IDLE; }
+	if (mode == "llc")  { return ANTAGONIST_LLC; }
+	if (mode == "bw")   { return ANTAGONIST_BW; }
+	throw std::logic_error("Unknown interference mode: " + mode + " (allowed: idle, llc, bw)");
+}
+
+/**
+ * Parses a comma separated list of cores, i.e. "2,3,4"
+ */
+inline std::vector<unsigned> parse_cores(const std::string& str) {
+	std::vector<unsigned> cores;
+	std::istringstream ss(str);
+	std::string tok;
+	while(std::getline(ss, tok, ',')) {
+		if (!tok.empty()) { cores.push_back(strtoul(tok.c_str(), NULL, 10)); }
+	}
+	return cores;
+}
+
+class Interference {
+
+	struct Antagonist {
+		pthread_t 				thread;
+		unsigned 				core;
+		const Interference*		parent;
+	};
+
+	AntagonistMode 			mode;
+	size_t 					footprint;
+	size_t 					cache_line;
+	std::vector<unsigned> 	cores;
+
+	std::vector<Antagonist> antagonists;
+	volatile bool 			running;
+
+	static size_t gcd(size_t a, size_t b) { return b == 0 ? a : gcd(b, a % b); }
+
+	static void* run(void* arg) {
+		const Antagonist& self = *static_cast<Antagonist*>(arg);
+		const Interference& parent = *self.parent;
+
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		CPU_SET(self.core, &mask);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+
+		if (parent.mode == ANTAGONIST_IDLE) {
+			while (parent.running) { usleep(1000); }
+			return NULL;
+		}
+
+		size_t lines = parent.footprint / parent.cache_line;
+		volatile char* data = new char[ lines * parent.cache_line ];
+		memset((char*)data, 1, lines * parent.cache_line);
+
+		// a stride (in lines) coprime with the number of lines visits every line of the 
+		// footprint before repeating
+		size_t stride = 1;
+		if (parent.mode == ANTAGONIST_LLC) {
+			stride = 4099 % lines;
+			while (gcd(stride, lines) != 1) { ++stride; }
+		}
+		size_t line = 0;
+		while (parent.running) {
+			for (size_t i=0; i<lines; ++i) {
+				data[line*parent.cache_line] += 1;
+				line += stride;
+				if (line >= lines) { line -= lines; }
+			}
+		}
+
+		delete[] data;
+		return NULL;
+	}
+
+public:
+
+	Interference(AntagonistMode mode, size_t footprint, size_t cache_line, const std::vector<unsigned>& cores) :
+		mode(mode), footprint(std::max(footprint, cache_line)), cache_line(cache_line), cores(cores), running(false) { }
+
+	AntagonistMode get_mode() const { return mode; }
+	const std::vector<unsigned>& get_cores() const { return cores; }
+
+	/**
+	 * Starts one antagonist for each of the cores
+	 */
+	void start() {
+		assert(!running && "Antagonists already running");
+
+		running = true;
+		antagonists.resize(cores.size());
+		for (size_t idx=0; idx<cores.size(); ++idx) {
+			antagonists[idx].core = cores[idx];
+			antagonists[idx].parent = this;
+			if (pthread_create(&antagonists[idx].thread, NULL, &Interference::run, &antagonists[idx]) != 0) {
+				antagonists.resize(idx);
+				stop();
+				throw std::logic_error("Error while starting the antagonist threads");
+			}
+		}
+	}
+
+	void stop() {
+		running = false;
+		for (size_t idx=0; idx<antagonists.size(); ++idx) {
+			pthread_join(antagonists[idx].thread, NULL);
+		}
+		antagonists.clear();
+	}
+
+	~Interference() { if (running) { stop(); } }
+
+private:
+	Interference(const Interference& other); // make it not copyable
+};
@@ -0,0 +1,184 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Detection of OS noise within a measured region: context switches, CPU migrations and page
+ * faults are counted with the software events of perf, the effective frequency is the ratio
+ * between the core cycles and the reference cycles (constant rate). All of them are read with
+ * a single read() of a perf event group. The cycle counters exclude the kernel, so they are
+ * available with perf_event_paranoid up to 2. When the software events are not available
+ * (they count in the kernel) context switches and page faults are taken from getrusage()
+ * and the cycle counters form a group on their own.
+ *
+ * The counters are read right before the timer of the region is started and after it is
+ * stopped, the system calls are not part of the measured time.
+ */
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include <cstring>
+#include <cmath>
+
+typedef long long NoiseValue;
+
+struct NoiseSample {
+	NoiseValue 	ctxsw;
+	NoiseValue 	migrations;
+	NoiseValue 	faults;
+	NoiseValue 	cycles;
+	NoiseValue 	ref_cycles;
+
+	NoiseSample() : ctxsw(0), migrations(0), faults(0), cycles(0), ref_cycles(0) { }
+
+	// cycles per reference cycle, 0 if not available
+	double freq_ratio() const { return ref_cycles > 0 ? static_cast<double>(cycles) / ref_cycles : 0; }
+};
+
+class NoiseMonitor {
+
+	enum { EVT_CTXSW, EVT_MIGRATIONS, EVT_FAULTS, EVT_CYCLES, EVT_REF_CYCLES, NUM_EVTS };
+
+	int 		fds[NUM_EVTS];
+	size_t 		num_fds;
+	// event of the group leader, EVT_CYCLES when the software events are not available
+	size_t 		first_evt;
+	bool 		enabled;
+
+	// effective frequency ratio measured at startup and accepted deviation from it
+	double 		reference;
+	double 		freq_tolerance;
+
+	static int open_event(unsigned type, unsigned long long config, int group) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_hv = 1;
+		// the software events count in the kernel (context switch, fault handlers)
+		attr.exclude_kernel = type == PERF_TYPE_HARDWARE;
+		return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+	}
+
+public:
+
+	NoiseMonitor() : num_fds(0), first_evt(EVT_CTXSW), enabled(false), reference(0), freq_tolerance(0) { }
+
+	bool is_enabled() const { return enabled; }
+	bool has_perf() const { return num_fds > 0 && first_evt == EVT_CTXSW; }
+	double get_reference() const { return reference; }
+
+	/**
+	 * Opens the perf events (software events first, the cycle counters are optional), the
+	 * reference frequency ratio is measured with a busy loop
+	 */
+	void enable(double tolerance) {
+		enabled = true;
+		freq_tolerance = tolerance;
+
+		const struct { unsigned type; unsigned long long config; } evts[NUM_EVTS] = {
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES }
+		};
+		open_group(evts, EVT_CTXSW);
+		if (num_fds < EVT_FAULTS+1) {
+			// the software events are all or nothing, otherwise getrusage is used
+			disable_perf();
+			open_group(evts, EVT_CYCLES);
+		}
+		if (first_evt + num_fds == EVT_REF_CYCLES) {
+			// core cycles alone do not tell the frequency
+			close(fds[--num_fds]);
+		}
+
+		if (first_evt + num_fds == NUM_EVTS) {
+			NoiseSample start, end;
+			read(start);
+			volatile unsigned long spin = 0;
+			for (unsigned long i=0; i<50000000; ++i) { spin += i; }
+			read(end);
+			end.cycles -= start.cycles;
+			end.ref_cycles -= start.ref_cycles;
+			reference = end.freq_ratio();
+		}
+	}
+
+	inline void read(NoiseSample& s) const {
+		NoiseValue* values[NUM_EVTS] = { &s.ctxsw, &s.migrations, &s.faults, &s.cycles, &s.ref_cycles };
+		if (num_fds) {
+			unsigned long long buf[NUM_EVTS+1];
+			if (::read(fds[0], buf, sizeof(buf)) > 0) {
+				for (size_t evt=EVT_CTXSW; evt<NUM_EVTS; ++evt) {
+					*values[evt] = evt >= first_evt && evt < first_evt + num_fds ? buf[1 + evt - first_evt] : 0;
+				}
+			}
+			if (first_evt == EVT_CTXSW) { return; }
+		}
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		s.ctxsw = usage.ru_nvcsw + usage.ru_nivcsw;
+		s.faults = usage.ru_minflt + usage.ru_majflt;
+	}
+
+	/**
+	 * Difference between two readings
+	 */
+	static NoiseSample delta(const NoiseSample& start, const NoiseSample& end) {
+		NoiseSample d;
+		d.ctxsw = end.ctxsw - start.ctxsw;
+		d.migrations = end.migrations - start.migrations;
+		d.faults = end.faults - start.faults;
+		d.cycles = end.cycles - start.cycles;
+		d.ref_cycles = end.ref_cycles - start.ref_cycles;
+		return d;
+	}
+
+	/**
+	 * A region is noisy if the process was descheduled, migrated, faulted or the core ran at
+	 * a frequency different from the reference one
+	 */
+	inline bool is_noisy(const NoiseSample& d) const {
+		if (d.ctxsw > 0 || d.migrations > 0 || d.faults > 0) { return true; }
+		return reference > 0 && d.ref_cycles > 0 && fabs(d.freq_ratio() / reference - 1) > freq_tolerance;
+	}
+
+	~NoiseMonitor() { disable_perf(); }
+
+private:
+	template <typename Events>
+	void open_group(const Events& evts, size_t first) {
+		first_evt = first;
+		for (size_t idx=first; idx<NUM_EVTS; ++idx) {
+			int fd = open_event(evts[idx].type, evts[idx].config, num_fds ? fds[0] : -1);
+			if (fd < 0) { break; }
+			fds[num_fds++] = fd;
+		}
+	}
+
+	void disable_perf() {
+		while (num_fds) { close(fds[--num_fds]); }
+	}
+};
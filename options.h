@@ -0,0 +1,72 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Optional benchmark modes are selected through environment variables (in the same way
+ * PAPI_HOME is), this keeps the positional command line of the benchmark untouched.
+ */
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Parses a size in the format XX, XXK, XXM, XXG (where X is a digit). Returns 0 if the
+ * quantifier is not recognized
+ */
+inline size_t parse_size(const std::string& str) {
+	if (str.empty()) { return 0; }
+
+	size_t multiplier = 1;
+	char last = str[str.length()-1];
+	if (!(last >= '0' && last <= '9')) {
+		switch (last) {
+		case 'G': multiplier *= 1024;
+		case 'M': multiplier *= 1024;
+		case 'K': multiplier *= 1024;
+				  break;
+		default:
+			return 0;
+		}
+	}
+	return strtoul(str.c_str(), NULL, 10) * multiplier;
+}
+
+/**
+ * Returns true if the environment variable is set to anything different from "0"
+ */
+inline bool env_flag(const char* name) {
+	const char* val = getenv(name);
+	return val && *val && strcmp(val, "0") != 0;
+}
+
+inline std::string env_string(const char* name, const std::string& def) {
+	const char* val = getenv(name);
+	return (val && *val) ? std::string(val) : def;
+}
+
+inline size_t env_size(const char* name, size_t def) {
+	const char* val = getenv(name);
+	return (val && *val) ? parse_size(val) : def;
+}
+
+inline double env_double(const char* name, double def) {
+	const char* val = getenv(name);
+	return (val && *val) ? strtod(val, NULL) : def;
+}
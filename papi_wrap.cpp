@@ -18,9 +18,11 @@
 #include "papi_wrap.h"
 #include <iterator>
 
+#include <unistd.h>
+
 //#define DEBUG
 
-PapiWrap::PapiWrap() : isCounting(false), evtSet(PAPI_NULL), evtNum(0), tmpValues(NULL) 
+PapiWrap::PapiWrap() : isCounting(false), evtSet(PAPI_NULL), evtNum(0) 
 {
 	int retval = PAPI_is_initialized();
 	if (retval) { return; }
@@ -31,8 +33,6 @@ PapiWrap::PapiWrap() : isCounting(false), evtSet(PAPI_NULL), evtNum(0), tmpValue
 
 	if (PAPI_set_debug(PAPI_VERB_ECONT) != PAPI_OK)
 		throw std::logic_error("Cannot set debug mode");
-
-	tmpValues = new long long[num_counters()];
 }
 
 size_t PapiWrap::num_counters() const {
@@ -85,9 +85,64 @@ void PapiWrap::set_events(const EventNames& evt_names) {
 	evtNum = size;
 }
 
-PapiWrap::~PapiWrap() { 
-	delete[] tmpValues;
+double cycles_per_usec() {
+	// makes sure the PAPI library is initialized 
+	PapiWrap wrapper;
+
+	long long start_usec = PAPI_get_real_usec();
+	long long start_cyc = PAPI_get_real_cyc();
+	usleep(100000);
+	long long end_cyc = PAPI_get_real_cyc();
+	long long end_usec = PAPI_get_real_usec();
+
+	return static_cast<double>(end_cyc-start_cyc) / (end_usec-start_usec);
+}
 
+OverflowSampler* volatile OverflowSampler::active = NULL;
+
+const NoiseMonitor* RegionCounter::noise_monitor = NULL;
+EnergyMeter* RegionCounter::energy_meter = NULL;
+Tracer* RegionCounter::tracer = NULL;
+
+void OverflowSampler::arm() {
+	assert(evtSet == PAPI_NULL && "Sampler already armed");
+
+	int error_code;
+	if ((error_code = PAPI_create_eventset(&evtSet)) != PAPI_OK ||
+		(error_code = PAPI_event_name_to_code(const_cast<char*>(evt_name.c_str()), &evtCode)) != PAPI_OK ||
+		(error_code = PAPI_add_event(evtSet, evtCode)) != PAPI_OK ||
+		(error_code = PAPI_overflow(evtSet, evtCode, threshold, 0, &OverflowSampler::handler)) != PAPI_OK) {
+		disarm();
+		throw std::logic_error(
+			std::string("PAPI: Error while setting up the sampling of ") + evt_name + ": " + PAPI_strerror(error_code)
+		);
+	}
+}
+
+void OverflowSampler::handler(int, void* address, long long, void*) {
+	OverflowSampler* self = active;
+	if (!self) { return; }
+
+	if (self->count < self->samples.size()) {
+		Sample& s = self->samples[self->count];
+		s.region = self->region;
+		s.address = address;
+		self->count = self->count + 1;
+	} else {
+		self->lost = self->lost + 1;
+	}
+}
+
+void OverflowSampler::disarm() {
+	if (evtSet == PAPI_NULL) { return; }
+
+	PAPI_overflow(evtSet, evtCode, 0, 0, &OverflowSampler::handler);
+	PAPI_cleanup_eventset(evtSet);
+	PAPI_destroy_eventset(&evtSet);
+	evtSet = PAPI_NULL;
+}
+
+PapiWrap::~PapiWrap() { 
 	if (evtSet != PAPI_NULL) {
 		PAPI_destroy_eventset(&evtSet);
 		evtSet = PAPI_NULL;
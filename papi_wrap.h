@@ -19,6 +19,10 @@
 
 #include <papi.h>
 
+#include "noise.h"
+#include "energy.h"
+#include "trace.h"
+
 #include <stdexcept>
 #include <cassert>
 
@@ -38,8 +42,6 @@ typedef std::vector<std::string>	EventNames;
 typedef long long					CounterValue;
 typedef std::vector<CounterValue> 	CounterValues;
 
-typedef std::pair<CounterValue, CounterValues> TimeValuePair;
-
 class PapiWrap {
 
 	bool 			isCounting;
@@ -48,8 +50,6 @@ class PapiWrap {
 	int  			evtSet;
 	size_t 			evtNum;
 
-	CounterValue* 	tmpValues;
-
 public:
 
 	/** 
@@ -70,9 +70,6 @@ public:
 	inline void start() {
 		assert(!isCounting && evtSet != PAPI_NULL && "Preconditions not satisfied!");
 
-		// reset the values in tmpValues 
-		memset(tmpValues, 0, sizeof(CounterValue)*num_counters());
-
 		isCounting = true;
 		if (evtNum != 0) {
 			int error_code;
@@ -86,30 +83,136 @@ public:
 		timer_start = PAPI_get_real_cyc();
 	}
 
-	inline TimeValuePair read() {
+	/**
+	 * Stops the counters and copies their values into values (which must have room for 
+	 * one value per event). Returns the cycles elapsed since start() was invoked
+	 */
+	inline CounterValue read(CounterValue* values) {
 
 		long long timer_end = PAPI_get_real_cyc();
 		assert(isCounting && "start() must be invoked first");
 
 		if (evtNum == 0) {
 			isCounting = false;
-			return std::make_pair(timer_end-timer_start, CounterValues());
+			return timer_end-timer_start;
 		}
 
 		int error_code;
-		if ((error_code = PAPI_stop(evtSet, tmpValues)) != PAPI_OK) {
+		if ((error_code = PAPI_stop(evtSet, values)) != PAPI_OK) {
 			throw std::logic_error(
 				std::string("PAPI: Error while reading counters: ") + PAPI_strerror(error_code)
 			);
 		}
 		
 		isCounting = false;	
-		return std::make_pair(timer_end-timer_start, CounterValues(tmpValues, tmpValues+evtNum));
+		return timer_end-timer_start;
+	}
+
+	/**
+	 * Reads the counters without stopping them, values must have room for one value per
+	 * event. Returns the cycles elapsed since start() was invoked
+	 */
+	inline CounterValue sample(CounterValue* values) {
+		CounterValue now = PAPI_get_real_cyc();
+		assert(isCounting && "start() must be invoked first");
+
+		if (evtNum != 0) {
+			int error_code;
+			if ((error_code = PAPI_read(evtSet, values)) != PAPI_OK) {
+				throw std::logic_error(
+					std::string("PAPI: Error while sampling counters: ") + PAPI_strerror(error_code)
+				);
+			}
+		}
+		return now-timer_start;
 	}
 
+	size_t num_events() const { return evtNum; }
+
+	// Cycle counter value at the last start()
+	CounterValue start_time() const { return timer_start; }
+
 	~PapiWrap();
 };
 
+/**
+ * Statistical sampling of an event: PAPI invokes an handler every threshold occurrences of
+ * the event and the handler records the interrupted instruction together with the region
+ * being executed. Samples are stored in a buffer allocated by the constructor (the handler
+ * runs in signal context), when the buffer is full further samples are dropped.
+ *
+ * The event set is created by arm() and destroyed by disarm(), the samples are kept in
+ * between so that they can be collected over many RegionCounter lifetimes (each of them
+ * initializes and shuts down the PAPI library). Only one sampler can be running at a time,
+ * and not together with a PapiWrap counting events (the time-only pass is fine).
+ */
+class OverflowSampler {
+
+public:
+	struct Sample {
+		unsigned long 	region;
+		void* 			address;
+	};
+
+	enum { MAX_SAMPLES = 1 << 20 };
+
+	OverflowSampler(const std::string& evt_name, int threshold) :
+		evt_name(evt_name), threshold(threshold), evtSet(PAPI_NULL), evtCode(0), samples(MAX_SAMPLES), 
+		count(0), lost(0), region(0) { }
+
+	/**
+	 * Sets up the overflow handler, the PAPI library must be initialized
+	 */
+	void arm();
+	void disarm();
+
+	inline void start(unsigned long region_id) {
+		region = region_id;
+		active = this;
+		int error_code;
+		if ((error_code = PAPI_start(evtSet)) != PAPI_OK) {
+			active = NULL;
+			throw std::logic_error(
+				std::string("PAPI: Error while starting the sampling: ") + PAPI_strerror(error_code)
+			);
+		}
+	}
+
+	inline void stop() {
+		CounterValue value;
+		PAPI_stop(evtSet, &value);
+		active = NULL;
+	}
+
+	size_t size() const { return count; }
+	const Sample& operator[](size_t idx) const { return samples[idx]; }
+	size_t dropped() const { return lost; }
+	void clear() { count = 0; lost = 0; }
+
+	~OverflowSampler() { disarm(); }
+
+private:
+	static void handler(int evt_set, void* address, long long overflow_vector, void* context);
+	static OverflowSampler* volatile active;
+
+	std::string 			evt_name;
+	int 					threshold;
+	int 					evtSet;
+	int 					evtCode;
+
+	std::vector<Sample> 	samples;
+	volatile size_t 		count;
+	volatile size_t 		lost;
+	volatile unsigned long 	region;
+
+	OverflowSampler(const OverflowSampler& other); // make it not copyable
+};
+
+/**
+ * Calibrates the cycle counter used for timing the regions against the real time clock
+ */
+double cycles_per_usec();
+
 /**
  * Computes the average value given an array of elements
  */
@@ -143,85 +246,254 @@ double stdev(const IterT& begin, const IterT& end) {
 }
 
 
+/**
+ * Computes the median value given an array of elements
+ */
+template <class IterT>
+double median(const IterT& begin, const IterT& end) {
+	std::vector<typename IterT::value_type> vals(begin, end);
+	if (vals.empty()) { return 0; }
+
+	size_t mid = vals.size()/2;
+	std::nth_element(vals.begin(), vals.begin()+mid, vals.end());
+	if (vals.size() % 2) { return vals[mid]; }
+	return (static_cast<double>(*std::max_element(vals.begin(), vals.begin()+mid)) + vals[mid]) / 2;
+}
+
 /**
  * Run a code region with multiple sections reading the values of the counters associated to each
  * ID.
+ *
+ * start()/end() are invoked within the measured code, therefore they do not allocate memory:
+ * regions are mapped to dense indices the first time they are seen (during the time-only
+ * pass) and their values are stored in arrays preallocated by the constructor. The passes
+ * start the regions in the same order, the index of a region is found by checking the one
+ * following the previous region (the registered regions are only searched when the order
+ * changes). The event set is configured by next(), outside of the measured code.
  */
 struct RegionCounter {
 
 	typedef unsigned long RegionID;
 
+	// Maximum number of regions within a test
+	enum { MAX_REGIONS = 16 };
+
 	struct RegionCounters {
 		RegionID 		id;
 		CounterValue 	time;
 		CounterValues 	values;
+		// cycle counter at the start of the region (time-only pass)
+		CounterValue 	start;
+		// OS noise and energy during the time-only pass
+		NoiseSample 	noise;
+		EnergySample 	energy;
 
-		RegionCounters(const RegionID& id, CounterValue time, const CounterValues& values) :
-			id(id), time(time), values(values) { 	}
+		RegionCounters(const RegionID& id, CounterValue time, const CounterValues& values, CounterValue start,
+					   const NoiseSample& noise, const EnergySample& energy) :
+			id(id), time(time), values(values), start(start), noise(noise), energy(energy) { 	}
+
+		bool operator<(const RegionCounters& other) const { return id < other.id; }
 	};
 
-	typedef std::map<RegionID, TimeValuePair> RegionMap;
+	RegionCounter(const EventNames& counter_names) :
+		counter_names (counter_names), curr_counter(-1), curr_region(0), available(false), configured(false),
+		tagged(false), state(-1), valid(true), sampler(NULL), noisy(false), num_regions(0), counter_values(MAX_REGIONS * std::max<size_t>(counter_names.size(), 1), 0) 
+	{ 
+		std::fill(times, times+MAX_REGIONS, 0);
+		std::fill(starts, starts+MAX_REGIONS, 0);
+		configure();
+	}
 
+	/**
+	 * Tags the measurement with the cache state observed before the regions and whether
+	 * the passes started from the intended state. Only the state of the time-only pass is
+	 * kept, the validity is the one of all the passes
+	 */
+	void tag_state(int observed, bool is_valid) {
+		if (curr_counter == -1) { state = observed; }
+		tagged = true;
+		valid = valid && is_valid;
+	}
 
-	RegionCounter(const EventNames& counter_names) :
-		counter_names (counter_names), curr_counter(-1), available(false) { }
+	bool is_tagged() const { return tagged; }
+	int observed_state() const { return state; }
+	bool is_valid() const { return valid; }
+
+	/**
+	 * Samples the regions of the time-only pass with the given sampler, which stays armed
+	 * for the lifetime of the RegionCounter
+	 */
+	void attach(OverflowSampler* s) {
+		assert(!sampler && "A sampler is already attached");
+		s->arm();
+		sampler = s;
+	}
+
+	~RegionCounter() { if (sampler) { sampler->disarm(); } }
+
+	/**
+	 * OS noise is recorded around every region when a monitor is set (for all the instances)
+	 */
+	static void set_noise_monitor(const NoiseMonitor* monitor) { noise_monitor = monitor; }
+	static const NoiseMonitor* get_noise_monitor() { return noise_monitor; }
+
+	/**
+	 * Energy is measured around every region of the time-only pass when a meter is set
+	 */
+	static void set_energy_meter(EnergyMeter* meter) { energy_meter = meter; }
+	static const EnergyMeter* get_energy_meter() { return energy_meter; }
 
-	bool isDone() const { return curr_counter == counter_names.size(); }
-	bool next() { return ++curr_counter == counter_names.size(); }
+	/**
+	 * Every region (of every pass) is recorded into the timeline when a tracer is set
+	 */
+	static void set_tracer(Tracer* t) { tracer = t; }
+
+	/**
+	 * Whether a region of the current pass was disturbed by the OS, resets the flag
+	 */
+	bool take_noisy() { bool ret = noisy; noisy = false; return ret; }
+
+	bool isDone() const { return curr_counter == static_cast<int>(counter_names.size()); }
+	bool next() { 
+		if (++curr_counter == static_cast<int>(counter_names.size())) { return true; }
+		configure();
+		return false;
+	}
+
+	/**
+	 * Dense index of a region, the region is registered the first time it is seen
+	 */
+	inline size_t add_region(const RegionID& id) {
+		for (size_t idx=0; idx<num_regions; ++idx) {
+			if (ids[idx] == id) { return idx; }
+		}
+		assert(curr_counter == -1 && "Regions must be registered during the time-only pass");
+		if (num_regions == MAX_REGIONS) { throw std::logic_error("Too many regions within a test"); }
+		ids[num_regions] = id;
+		return num_regions++;
+	}
 
 	inline void start(const RegionID& id) {
+		size_t expected = num_regions && curr_region+1 < num_regions ? curr_region+1 : 0;
+		curr_region = expected < num_regions && ids[expected] == id ? expected : add_region(id);
+		if (!configured) { return; }
+
+		if (noise_monitor) { noise_monitor->read(noise_start); }
+		if (energy_meter && curr_counter == -1) { energy_meter->read(); }
+
 		try {
-			EventNames counters;
-			if (curr_counter != -1) {
-				counters.push_back(counter_names[curr_counter]);
-			} 
-			wrapper.set_events( counters );
-			
 			wrapper.start();
 			available = true;
+			if (sampler && curr_counter == -1) { sampler->start(id); }
 		} catch(const std::logic_error& e) { // std::cerr << "EXCEPTION: " << e.what() << std::endl; 
 		}
 	}
 
 	inline void end(const RegionID& id) {
-		TimeValuePair ret = available ? 
-			wrapper.read() : 
-			TimeValuePair(0, CounterValues(1));
-
-		RegionMap::iterator fit = counter_values.find(id);
-		if (fit == counter_values.end()) {
-			assert(curr_counter == -1);
-			fit = counter_values.insert(
-					std::make_pair(id, std::make_pair(ret.first, CounterValues()))
-				).first;
+		assert(ids[curr_region] == id && "Regions cannot be nested");
+
+		if (sampler && available && curr_counter == -1) { sampler->stop(); }
+
+		CounterValue value = 0, time = 0;
+		if (available) { time = wrapper.read(&value); }
+
+		if (tracer && available) { tracer->record(TRACE_REGION, id, wrapper.start_time(), wrapper.start_time()+time); }
+		if (energy_meter && available && curr_counter == -1) { energy[curr_region] = energy_meter->read(); }
+
+		if (noise_monitor && available) {
+			NoiseSample noise_end;
+			noise_monitor->read(noise_end);
+			const NoiseSample& delta = NoiseMonitor::delta(noise_start, noise_end);
+			if (curr_counter == -1) { noise[curr_region] = delta; }
+			noisy = noisy || noise_monitor->is_noisy(delta);
+		}
+
+		if (curr_counter == -1) {
+			times[curr_region] = time;
+			starts[curr_region] = available ? wrapper.start_time() : 0;
+		} else {
+			counter_values[curr_region*counter_names.size() + curr_counter] = value;
 		}
-		RegionMap::value_type& entry = *fit;
-		std::copy(ret.second.begin(), ret.second.end(), std::back_inserter(entry.second.second));
 		available = false;
 	}
 
 	inline std::vector<RegionCounters> values() const { 
 		std::vector<RegionCounters> ret;
-		for(RegionMap::const_iterator it=counter_values.begin(), end=counter_values.end(); it != end; ++it) 
-			ret.push_back( RegionCounters(it->first, it->second.first, it->second.second) );
+		for(size_t idx=0; idx<num_regions; ++idx) {
+			CounterValues::const_iterator begin = counter_values.begin() + idx*counter_names.size();
+			ret.push_back( RegionCounters(ids[idx], times[idx], CounterValues(begin, begin+counter_names.size()), starts[idx], 
+										  noise[idx], energy[idx]) );
+		}
+		std::sort(ret.begin(), ret.end());
 		return ret;
 	}
 
 private:
+	// Sets the event of the current pass (none for the time-only pass)
+	void configure() {
+		try {
+			EventNames counters;
+			if (curr_counter != -1) {
+				counters.push_back(counter_names[curr_counter]);
+			} 
+			wrapper.set_events( counters );
+			configured = true;
+		} catch(const std::logic_error& e) { 
+			configured = false; 
+		}
+	}
+
 	PapiWrap 		wrapper;
 	EventNames 		counter_names;
 
 	int 			curr_counter;
+	size_t 			curr_region;
 	bool			available;
+	bool 			configured;
+
+	bool 			tagged;
+	int 			state;
+	bool 			valid;
+
+	OverflowSampler* sampler;
+
+	static const NoiseMonitor* noise_monitor;
+	NoiseSample 	noise_start;
+	NoiseSample 	noise[MAX_REGIONS];
+	bool 			noisy;
 
-	RegionMap 		counter_values;
+	static EnergyMeter* energy_meter;
+	static Tracer* 		tracer;
+	EnergySample 	energy[MAX_REGIONS];
+
+	size_t 			num_regions;
+	RegionID 		ids[MAX_REGIONS];
+	CounterValue 	times[MAX_REGIONS];
+	CounterValue 	starts[MAX_REGIONS];
+	// values of region i are stored at [i*counter_names.size(), (i+1)*counter_names.size())
+	CounterValues	counter_values;
 };
 
 
+typedef std::map<RegionCounter::RegionID, std::vector<CounterValue> > RegionSamples;
+
+// Energy and time of a region summed over the repetitions
+struct EnergyTotals {
+	EnergyValue 	pkg;
+	EnergyValue 	dram;
+	CounterValue 	time;
+	unsigned 		count;
+
+	EnergyTotals() : pkg(0), dram(0), time(0), count(0) { }
+};
+
+typedef std::map<RegionCounter::RegionID, EnergyTotals> RegionEnergy;
+
 // Measuring Function ///////////////////////////////////////////////////////////////////////////////////
 
 template <class FuncTy>
-inline void measure(std::ostream& log, const EventNames& evts, const FuncTy& func, size_t rep = 10) {
+inline void measure(std::ostream& log, const EventNames& evts, const FuncTy& func, size_t rep = 10, 
+					RegionSamples* samples = NULL, RegionEnergy* energy = NULL, RegionSamples* starts = NULL) {
 
 	for (unsigned idx=0; idx<rep; ++idx) {
 
@@ -241,11 +513,34 @@ inline void measure(std::ostream& log, const EventNames& evts, const FuncTy& fun
 		for (std::vector<RegionCounter::RegionCounters>::const_iterator it=values.begin(), end=values.end(); it!=end; ++it) {
 			log << std::setw(10) << it->id 
 				<< std::setw(15) << it->time;
+			if (reg.is_tagged()) {
+				log << std::setw(8) << reg.observed_state() << std::setw(6) << reg.is_valid();
+			}
+			if (RegionCounter::get_noise_monitor()) {
+				log << std::setw(10) << it->noise.ctxsw << std::setw(10) << it->noise.migrations 
+					<< std::setw(10) << it->noise.faults 
+					<< std::setw(10) << std::fixed << std::setprecision(3) << it->noise.freq_ratio();
+				log.unsetf(std::ios::floatfield);
+				log.precision(6);
+			}
+			if (RegionCounter::get_energy_meter()) {
+				log << std::setw(10) << it->energy.pkg << std::setw(10) << it->energy.dram;
+			}
 			// Write the valueas of the counters 
 			for (CounterValues::const_iterator vit=it->values.begin(), vend=it->values.end(); vit!=vend; ++vit) {
 				log << std::setw(25) << *vit;
 			}
 			log << std::flush << std::endl;
+
+			if (samples) { (*samples)[it->id].push_back(it->time); }
+			if (starts) { (*starts)[it->id].push_back(it->start); }
+			if (energy) {
+				EnergyTotals& tot = (*energy)[it->id];
+				tot.pkg += it->energy.pkg;
+				tot.dram += it->energy.dram;
+				tot.time += it->time;
+				++tot.count;
+			}
 		}
 	}	
 
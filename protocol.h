@@ -0,0 +1,168 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Detection of the MPI protocol thresholds (i.e. eager -> rendezvous). The power of two size
+ * sweep only shows a jump somewhere between two sizes, we look for discontinuities in the
+ * time and LLC miss curves and refine each of them with a bisection.
+ *
+ * The sampler is a functor returning a ProtocolPoint for a given message size. Because the
+ * sampled sizes depend on the measured values, the sampler has to return the same values on
+ * every rank (the values are reduced among the processes) otherwise the ranks diverge.
+ */
+
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+struct ProtocolPoint {
+	size_t size;
+	// Time of the transfer (max among the ranks)
+	double time;
+	// LLC misses measured by the sender [0] and the receiver [1]
+	double misses[2];
+};
+
+struct ProtocolThreshold {
+	// Largest size measured with the old protocol and smallest size with the new one
+	ProtocolPoint below, above;
+	bool by_time;
+	bool by_misses;
+};
+
+typedef std::vector<ProtocolThreshold> ProtocolThresholds;
+
+namespace detail {
+
+	// Growth of the curve from point a to point b; small counts are clamped to avoid
+	// reporting noise of almost empty counters as discontinuities
+	inline double growth(double a, double b, double floor) {
+		return std::max(b, floor) / std::max(a, floor);
+	}
+
+	// The step i (from point i to i+1) is a discontinuity when it grows considerably
+	// faster than the neighbouring steps
+	inline bool is_jump(const std::vector<double>& steps, size_t i, double jump) {
+		double ref = 0;
+		unsigned n = 0;
+		if (i > 0)				 { ref += steps[i-1]; ++n; }
+		if (i+1 < steps.size())  { ref += steps[i+1]; ++n; }
+		if (n == 0) { return false; }
+		return steps[i] > jump * (ref / n);
+	}
+
+	inline double miss_metric(const ProtocolPoint& p) { return p.misses[0] + p.misses[1]; }
+
+} // end detail namespace
+
+template <class SamplerTy>
+ProtocolThresholds detect_protocol_thresholds(const SamplerTy& sample,
+											  size_t min_size,
+											  size_t max_size,
+											  size_t resolution,
+											  double jump,
+											  double miss_floor = 64)
+{
+	// Coarse power of two sweep
+	std::vector<ProtocolPoint> points;
+	for (size_t size = min_size; size <= max_size; size *= 2) {
+		points.push_back( sample(size) );
+	}
+
+	ProtocolThresholds ret;
+	if (points.size() < 2) { return ret; }
+
+	std::vector<double> time_steps, miss_steps[2];
+	for (size_t i=0; i+1<points.size(); ++i) {
+		time_steps.push_back( detail::growth(points[i].time, points[i+1].time, 1) );
+		for (unsigned r=0; r<2; ++r) {
+			miss_steps[r].push_back(
+				detail::growth(points[i].misses[r], points[i+1].misses[r], miss_floor)
+			);
+		}
+	}
+
+	for (size_t i=0; i<time_steps.size(); ++i) {
+		bool by_time = detail::is_jump(time_steps, i, jump);
+		bool by_misses = detail::is_jump(miss_steps[0], i, jump) || detail::is_jump(miss_steps[1], i, jump);
+		if (!by_time && !by_misses) { continue; }
+
+		// Bisection on the metric which showed the discontinuity, the step is in the half
+		// where the metric covers more than half of the total gap
+		ProtocolPoint lo = points[i], hi = points[i+1];
+		while (hi.size - lo.size > resolution) {
+			size_t mid = (lo.size + hi.size) / 2 / resolution * resolution;
+			if (mid <= lo.size || mid >= hi.size) { break; }
+
+			ProtocolPoint pm = sample(mid);
+			double m_lo = by_time ? lo.time : detail::miss_metric(lo);
+			double m_hi = by_time ? hi.time : detail::miss_metric(hi);
+			double m_mid = by_time ? pm.time : detail::miss_metric(pm);
+
+			if (m_mid - m_lo > (m_hi - m_lo) / 2) {
+				hi = pm;
+			} else {
+				lo = pm;
+			}
+		}
+
+		ProtocolThreshold th;
+		th.below = lo;
+		th.above = hi;
+		th.by_time = by_time;
+		th.by_misses = by_misses;
+		ret.push_back(th);
+	}
+	return ret;
+}
+
+/**
+ * Prints the detected thresholds, one per line, with the change of LLC misses on the sender
+ * and on the receiver side
+ */
+inline void print_protocol_thresholds(std::ostream& out, const std::string& state, const ProtocolThresholds& ths) {
+	for (ProtocolThresholds::const_iterator it=ths.begin(), end=ths.end(); it!=end; ++it) {
+		out << std::setw(8)  << state
+			<< std::setw(12) << it->below.size
+			<< std::setw(12) << it->above.size
+			<< std::setw(15) << it->below.time
+			<< std::setw(15) << it->above.time
+			<< std::setw(15) << it->below.misses[0]
+			<< std::setw(15) << it->above.misses[0]
+			<< std::setw(15) << it->below.misses[1]
+			<< std::setw(15) << it->above.misses[1]
+			<< std::setw(10) << (it->by_time ? (it->by_misses ? "both" : "time") : "llc")
+			<< std::endl;
+	}
+}
+
+inline void print_protocol_header(std::ostream& out) {
+	out << std::setw(8)  << "state"
+		<< std::setw(12) << "below"
+		<< std::setw(12) << "above"
+		<< std::setw(15) << "time_below"
+		<< std::setw(15) << "time_above"
+		<< std::setw(15) << "snd_llc_below"
+		<< std::setw(15) << "snd_llc_above"
+		<< std::setw(15) << "rcv_llc_below"
+		<< std::setw(15) << "rcv_llc_above"
+		<< std::setw(10) << "trigger"
+		<< std::endl;
+}
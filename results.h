@@ -0,0 +1,175 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Loading of the cache_bench.r*.csv result files for the offline analysis tools.
+ *
+ * Region IDs are decoded as: C * 1000000 + TTT * 1000 + R * 100 + S, where C is the
+ * condition (1 when measured under interference), TTT the test (which includes the cache
+ * state), R the region within the test and S the index of the size (size = 64 << (S-1)).
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+typedef unsigned long RegionID;
+
+struct RegionKey {
+	// ID of the region without the size index, i.e. 305200 or 1305200
+	RegionID 	base;
+	size_t 		size;
+
+	RegionKey(RegionID base, size_t size) : base(base), size(size) { }
+
+	bool operator<(const RegionKey& other) const {
+		return base < other.base || (base == other.base && size < other.size);
+	}
+};
+
+inline size_t region_size(RegionID id) {
+	unsigned idx = id % 100;
+	return idx == 0 ? 0 : size_t(64) << (idx-1);
+}
+
+inline RegionID region_base(RegionID id) { return id - id % 100; }
+
+inline unsigned region_condition(RegionID id) { return id / 1000000; }
+
+/**
+ * Human readable name of a region (without size), i.e. "comm/cold"
+ */
+inline std::string region_name(RegionID base) {
+	static const char* states[] = { "cold", "read", "write" };
+
+	unsigned test = (base % 1000000) / 1000;
+	unsigned region = (base % 1000) / 100;
+
+	std::ostringstream ss;
+	if (test >= 305 && test <= 307) {
+		ss << "comm/" << states[test-305];
+	} else if (test >= 408 && test <= 416) {
+		static const char* copies[] = { "memcpy", "ntcopy", "handoff" };
+		ss << copies[(test-408)/3] << "/" << states[(test-408)%3];
+	} else if (test >= 540 && test <= 542) {
+		ss << "pingpong/" << states[test-540];
+	} else if (test >= 550 && test <= 552) {
+		ss << "stream/" << states[test-550];
+	} else if (test >= 560 && test <= 578) {
+		unsigned st = (test-560) % 10;
+		ss << (test < 570 ? "sendrecv/" : "isendrecv/") << states[st/3] << "/" << states[st%3];
+		if (test >= 570) { ss << (region == 2 ? "/send" : "/recv"); }
+	} else if (test >= 600 && test <= 622 && test%10 < 3) {
+		ss << "asym/" << states[(test-600)/10] << "/" << states[test%10];
+	} else if (test >= 200 && test <= 241 && test%10 < 2) {
+		static const char* hints[] = { "none", "pf_post", "pf_done", "cldemote", "nt_send" };
+		static const char* parts[] = { "", "comm", "access" };
+		ss << "hint/" << hints[(test-200)/10] << "/" << (test%10 ? "write" : "read") << "/" << (region <= 2 ? parts[region] : "?");
+	} else if (test >= 700 && test <= 785 && (test/10)%5 < 3 && test%10 < 6) {
+		static const char* widths[] = { "w1", "w8", "wline" };
+		static const char* parts[] = { "", "comm", "observe" };
+		unsigned obs = (test-700)/10;
+		ss << "scenario/" << states[test%10%3] << "/" << (test%10 < 3 ? "none" : "comm") << "/" 
+		   << (obs < 5 ? "read" : "write") << "/" << widths[obs%5] << "/" << (region <= 2 ? parts[region] : "?");
+	} else if (test >= 900 && test <= 962 && test%10 < 3) {
+		static const char* parts[] = { "", "many", "pack", "send", "unpack" };
+		ss << "aggregate/" << (1u << (test-900)/10) << "/" << states[test%10] << "/" << (region <= 4 ? parts[region] : "?");
+	} else {
+		ss << "test" << test << "." << region;
+	}
+
+	if (region_condition(base) == 1) { ss << "@loaded"; }
+	return ss.str();
+}
+
+struct ResultSet {
+	std::vector<std::string> 					columns;
+	// time samples of each region
+	std::map<RegionKey, std::vector<double> > 	times;
+	// counter samples of each region, one vector per column
+	std::map<RegionKey, std::vector<std::vector<double> > > counters;
+};
+
+/**
+ * Index of the first counter column of a result file header: id time [state valid] 
+ * [os_ctxsw os_migr os_faults os_freq] [en_pkg en_dram] counters...
+ */
+inline size_t first_counter_column(const std::vector<std::string>& names) {
+	size_t first_counter = 2;
+	for (size_t idx=0; idx<names.size(); ++idx) {
+		// cache state verification, OS noise and energy columns
+		if (names[idx] == "state" || names[idx] == "valid" || names[idx].compare(0, 3, "os_") == 0 ||
+			names[idx].compare(0, 3, "en_") == 0) { 
+			first_counter = idx+1; 
+		}
+	}
+	return first_counter;
+}
+
+/**
+ * Loads a result file, samples marked as not valid by the cache state verification are
+ * skipped unless keep_invalid is set
+ */
+inline ResultSet load_results(const std::string& file_name, bool keep_invalid = false) {
+	std::ifstream file(file_name.c_str());
+	if (!file) { throw std::logic_error("Cannot open result file: " + file_name); }
+
+	ResultSet ret;
+	std::string line;
+	if (!std::getline(file, line)) { return ret; }
+
+	// header: id time [state valid] [os_ctxsw os_migr os_faults os_freq] [en_pkg en_dram] counters...
+	std::istringstream header(line);
+	std::vector<std::string> names;
+	std::string name;
+	while (header >> name) { names.push_back(name); }
+
+	int valid_col = -1;
+	for (size_t idx=0; idx<names.size(); ++idx) {
+		if (names[idx] == "valid") { valid_col = idx; }
+	}
+	size_t first_counter = first_counter_column(names);
+	ret.columns.assign(names.begin()+std::min(first_counter, names.size()), names.end());
+
+	while (std::getline(file, line)) {
+		std::istringstream row(line);
+		std::vector<double> vals;
+		double v;
+		while (row >> v) { vals.push_back(v); }
+		if (vals.size() < 2) { continue; }
+		if (!keep_invalid && valid_col >= 0 && static_cast<size_t>(valid_col) < vals.size() && vals[valid_col] == 0) {
+			continue;
+		}
+
+		RegionID id = static_cast<RegionID>(vals[0]);
+		RegionKey key(region_base(id), region_size(id));
+		ret.times[key].push_back(vals[1]);
+
+		std::vector<std::vector<double> >& cnt = ret.counters[key];
+		cnt.resize(ret.columns.size());
+		for (size_t idx=0; idx<ret.columns.size() && first_counter+idx<vals.size(); ++idx) {
+			cnt[idx].push_back(vals[first_counter+idx]);
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,123 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Access kernels of the composed scenarios and of the sweep. The cache line and the access
+ * width are template parameters: the stride, the number of words per line and the unrolling
+ * are known at compile time, the timed loops are fully specialized. The kernels access plain memory
+ * (the caller's buffer is volatile only to keep the compiler from moving the untimed
+ * accesses) so that the compiler is free to unroll and vectorize them.
+ */
+
+#include <stdint.h>
+#include <cstring>
+
+// Widest integer word which divides the access width
+template <size_t Width> struct AccessWord { typedef uint64_t type; };
+template <> struct AccessWord<1> { typedef uint8_t type; };
+template <> struct AccessWord<2> { typedef uint16_t type; };
+template <> struct AccessWord<4> { typedef uint32_t type; };
+
+/**
+ * Accesses the first Width bytes of every line of the buffer, lines are Line bytes apart
+ */
+template <size_t Line, size_t Width>
+struct LineAccess {
+
+	typedef typename AccessWord<Width>::type Word;
+
+	enum { WORDS = Width / sizeof(Word), UNROLL = 4 };
+
+	// fails to compile if the width does not fit into the line or is not a multiple of the word
+	typedef char width_fits_line[ (Width <= Line && Width % sizeof(Word) == 0) ? 1 : -1 ];
+
+	static inline Word load(const char* p) {
+		Word acc = 0;
+		for (size_t w=0; w<WORDS; ++w) {
+			Word val;
+			memcpy(&val, p + w*sizeof(Word), sizeof(Word));
+			acc += val;
+		}
+		return acc;
+	}
+
+	static inline void update(char* p, Word inc) {
+		for (size_t w=0; w<WORDS; ++w) {
+			Word val;
+			memcpy(&val, p + w*sizeof(Word), sizeof(Word));
+			val += inc;
+			memcpy(p + w*sizeof(Word), &val, sizeof(Word));
+		}
+	}
+
+	/**
+	 * Loads every line (forward), returns the sum of the loaded words
+	 */
+	static inline size_t read(const volatile char* buf, size_t size) {
+		const char* p = const_cast<const char*>(buf);
+		Word acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+		size_t idx = 0;
+		for (; idx + UNROLL*Line <= size; idx += UNROLL*Line) {
+			acc0 += load(p + idx);
+			acc1 += load(p + idx + Line);
+			acc2 += load(p + idx + 2*Line);
+			acc3 += load(p + idx + 3*Line);
+		}
+		for (; idx < size; idx += Line) { acc0 += load(p + idx); }
+		return acc0 + acc1 + acc2 + acc3;
+	}
+
+	/**
+	 * Read-modify-write of every line (forward)
+	 */
+	static inline void write(volatile char* buf, size_t size, size_t inc) {
+		char* p = const_cast<char*>(buf);
+		const Word v = static_cast<Word>(inc);
+		size_t idx = 0;
+		for (; idx + UNROLL*Line <= size; idx += UNROLL*Line) {
+			update(p + idx, v);
+			update(p + idx + Line, v);
+			update(p + idx + 2*Line, v);
+			update(p + idx + 3*Line, v);
+		}
+		for (; idx < size; idx += Line) { update(p + idx, v); }
+	}
+};
+
+/**
+ * Kernels of the sweep, the line size is known at run time: 64 and 128 bytes lines run the
+ * specialized kernels (first byte of every line), any other line the generic loop
+ */
+inline size_t read_lines(const volatile char* buf, size_t size, size_t line) {
+	switch (line) {
+		case 64: 	return LineAccess<64,1>::read(buf, size);
+		case 128: 	return LineAccess<128,1>::read(buf, size);
+	}
+	size_t acc = 0;
+	for (size_t idx=0; idx<size; idx+=line) { acc += buf[idx]; }
+	return acc;
+}
+
+inline void write_lines(volatile char* buf, size_t size, size_t line, size_t inc) {
+	switch (line) {
+		case 64: 	LineAccess<64,1>::write(buf, size, inc); return;
+		case 128: 	LineAccess<128,1>::write(buf, size, inc); return;
+	}
+	for (size_t idx=0; idx<size; idx+=line) { buf[idx] += inc; }
+}
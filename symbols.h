@@ -0,0 +1,55 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Symbolization of code addresses against the loaded shared objects
+ */
+
+#include <dlfcn.h>
+
+#include <string>
+#include <sstream>
+#include <cstring>
+
+/**
+ * Name of the shared object (without path) which contains the address, "??" if unknown
+ */
+inline std::string object_name(const void* addr) {
+	Dl_info info;
+	if (!addr || !dladdr(addr, &info) || !info.dli_fname) { return "??"; }
+	const char* base = strrchr(info.dli_fname, '/');
+	return base ? base+1 : info.dli_fname;
+}
+
+/**
+ * Name of the function containing the address (mangled, so that it contains no spaces).
+ * Functions which are not exported are reported as object+offset (for addr2line)
+ */
+inline std::string symbol_name(const void* addr) {
+	Dl_info info;
+	if (!addr || !dladdr(addr, &info)) { return "??"; }
+
+	if (info.dli_sname) { return info.dli_sname; }
+	if (!info.dli_fname) { return "??"; }
+
+	std::ostringstream ss;
+	ss << object_name(addr) << "+0x" << std::hex
+	   << (static_cast<const char*>(addr) - static_cast<const char*>(info.dli_fbase));
+	return ss.str();
+}
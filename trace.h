@@ -0,0 +1,112 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Timeline of the phases of the tests (cache cleaning, loads, barriers, synchronizations and
+ * measured regions). Records are stored into a ring buffer allocated at startup, recording
+ * is two stores and an increment (each process has its own buffer, written by a single
+ * thread), when the buffer is full the oldest records are overwritten. The timeline is
+ * written as Chrome trace JSON (chrome://tracing, Perfetto) after the run.
+ */
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+
+enum TraceKind { TRACE_REGION, TRACE_CLEAN, TRACE_RLOAD, TRACE_WLOAD, TRACE_BARRIER, TRACE_SYNC };
+
+struct TraceRecord {
+	unsigned long 	id; // region ID (0 for the other phases)
+	long long 		start;
+	long long 		end;
+	int 			kind;
+};
+
+class Tracer {
+
+	std::vector<TraceRecord> 	ring;
+	size_t 						mask;
+	size_t 						head;
+
+public:
+
+	/**
+	 * The capacity is rounded up to a power of two
+	 */
+	Tracer(size_t capacity) : mask(0), head(0) {
+		size_t cap = 1;
+		while (cap < capacity) { cap <<= 1; }
+		ring.resize(cap);
+		mask = cap - 1;
+	}
+
+	inline void record(TraceKind kind, unsigned long id, long long start, long long end) {
+		TraceRecord& r = ring[head & mask];
+		r.id = id;
+		r.start = start;
+		r.end = end;
+		r.kind = kind;
+		++head;
+	}
+
+	size_t dropped() const { return head > ring.size() ? head - ring.size() : 0; }
+
+	/**
+	 * Records from the oldest to the newest
+	 */
+	std::vector<TraceRecord> records() const {
+		std::vector<TraceRecord> ret;
+		for (size_t idx=dropped(); idx<head; ++idx) { ret.push_back(ring[idx & mask]); }
+		return ret;
+	}
+};
+
+inline const char* trace_kind_name(int kind) {
+	static const char* names[] = { "region", "clean", "rload", "wload", "barrier", "sync" };
+	return kind >= 0 && kind <= TRACE_SYNC ? names[kind] : "?";
+}
+
+/**
+ * Writes the records of a process as complete events ("ph":"X") of the Chrome trace format,
+ * timestamps are converted to usecs since origin (cycles). Use write_chrome_header/footer
+ * around the events of all the processes.
+ */
+template <class NameFunc, class TimeFunc>
+void write_chrome_events(std::ostream& out, const std::vector<TraceRecord>& records, int pid, bool& first,
+						 double origin, double cpu_mhz, const NameFunc& region_name, const TimeFunc& to_global) {
+	out << std::fixed << std::setprecision(3);
+	for (size_t idx=0; idx<records.size(); ++idx) {
+		const TraceRecord& r = records[idx];
+		double start = to_global(r.start), end = to_global(r.end);
+
+		out << (first ? "\n" : ",\n") << "{\"name\":\""
+			<< (r.kind == TRACE_REGION ? region_name(r.id) : std::string(trace_kind_name(r.kind)))
+			<< "\",\"cat\":\"" << trace_kind_name(r.kind) << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":0"
+			<< ",\"ts\":" << (start - origin) / cpu_mhz << ",\"dur\":" << (end - start) / cpu_mhz;
+		if (r.kind == TRACE_REGION) { out << ",\"args\":{\"id\":" << r.id << "}"; }
+		out << "}";
+		first = false;
+	}
+	out.unsetf(std::ios::floatfield);
+	out << std::setprecision(6);
+}
+
+inline void write_chrome_header(std::ostream& out) { out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":["; }
+inline void write_chrome_footer(std::ostream& out) { out << "\n]}\n"; }
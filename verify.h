@@ -0,0 +1,144 @@
+/**
+ *  This file is part of mpi-cache-bench.
+ *
+ *  mpi-cache-bench is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mpi-cache-bench is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mpi-cache-bench.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Verification of the cache state right before a measured region. A few lines spread over
+ * the buffer are loaded with a chain of dependent loads and the average latency tells whether
+ * the buffer is cached (hot) or not (cold). The threshold between the two is calibrated at
+ * startup.
+ *
+ * Probing brings the probed lines into the cache, when a buffer is found cold the lines are
+ * flushed again so that the intended state of the test is not altered.
+ */
+
+#include "papi_wrap.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+enum ProbeState { PROBE_COLD=0, PROBE_HOT=1 };
+
+class CacheProbe {
+
+	enum { PROBE_LINES = 8 };
+
+	double 		threshold;
+	unsigned 	retries;
+	bool 		enabled;
+
+	// Result of the current pass: bit i is set if the i-th probed buffer was hot
+	int 		observed;
+	unsigned 	probes;
+	bool 		valid;
+
+	static inline void flush(volatile char* line) {
+#ifdef __SSE2__
+		_mm_clflush(const_cast<char*>(line));
+#endif
+	}
+
+	// Average latency (in cycles) of a load to the probed lines
+	static inline double latency(volatile char* b, size_t size, size_t cache_line, size_t lines) {
+		size_t step = std::max(size / lines / cache_line, size_t(1)) * cache_line;
+
+		// every address depends on the previous load (the offset is either 0 or 1, within the 
+		// same line) so the loads are not overlapped
+		long dep = 0;
+		CounterValue start = PAPI_get_real_cyc();
+		for (size_t i=0; i<lines; ++i) {
+			dep = b[i*step + (dep < 0)];
+		}
+		CounterValue end = PAPI_get_real_cyc();
+
+		return static_cast<double>(end-start) / lines;
+	}
+
+public:
+
+	CacheProbe() : threshold(0), retries(3), enabled(false), observed(0), probes(0), valid(true) { }
+
+	bool is_enabled() const { return enabled; }
+	unsigned max_retries() const { return retries; }
+	double get_threshold() const { return threshold; }
+
+	/**
+	 * Measures the probe latency of a hot and of a flushed buffer and puts the threshold
+	 * in the middle (geometric mean), unless a threshold is given
+	 */
+	void enable(size_t cache_line, unsigned max_retries, double fixed_threshold = 0) {
+		enabled = true;
+		retries = max_retries;
+		threshold = fixed_threshold;
+		if (threshold > 0) { return; }
+
+		PapiWrap wrapper; // makes sure the PAPI library is initialized
+
+		size_t size = PROBE_LINES * cache_line * 4;
+		volatile char* b = new char[size];
+		memset((char*)b, 1, size);
+
+		std::vector<double> hot, cold;
+		for (unsigned rep=0; rep<101; ++rep) {
+			for (size_t i=0; i<size; i+=cache_line) { b[i] += 1; }
+			hot.push_back( latency(b, size, cache_line, PROBE_LINES) );
+
+			for (size_t i=0; i<size; i+=cache_line) { flush(&b[i]); }
+			cold.push_back( latency(b, size, cache_line, PROBE_LINES) );
+		}
+		delete[] b;
+
+		threshold = sqrt(median(hot.begin(), hot.end()) * median(cold.begin(), cold.end()));
+	}
+
+	/**
+	 * Resets the result before a new pass of a test
+	 */
+	void reset() { observed = 0; probes = 0; valid = true; }
+
+	/**
+	 * Classifies the state of the buffer and checks it against the intended one
+	 */
+	inline void check(ProbeState expected, volatile char* b, size_t size, size_t cache_line) {
+		size_t lines = std::min<size_t>(PROBE_LINES, std::max(size / cache_line, size_t(1)));
+		ProbeState state = latency(b, size, cache_line, lines) < threshold ? PROBE_HOT : PROBE_COLD;
+
+		if (state == PROBE_COLD) {
+			size_t step = std::max(size / lines / cache_line, size_t(1)) * cache_line;
+			for (size_t i=0; i<lines; ++i) { flush(&b[i*step]); }
+		}
+
+		observed |= state << probes++;
+		valid = valid && (state == expected);
+	}
+
+	/**
+	 * Buffer which is not probed (its state cannot be obtained), it keeps the position of the
+	 * following probes in observed and counts as cold
+	 */
+	void skip() { ++probes; }
+
+	// -1 if no buffer was probed during the pass
+	int get_observed() const { return probes ? observed : -1; }
+	bool is_valid() const { return valid; }
+};